@@ -43,6 +43,7 @@
 #include "sound.h"
 #include "cpu-emu.h"
 #include "sig.h"
+#include "deadline.h"
 
 #define SIGALTSTACK_WA_DEFAULT 1
 #if SIGALTSTACK_WA_DEFAULT
@@ -176,7 +177,9 @@ static void (*asighandlers[NSIG])(void *arg);
 static struct sigaction sacts[NSIG];
 
 static void SIGALRM_call(void *arg);
+static void periodic_tick(void *arg);
 static void SIGIO_call(void *arg);
+static int tick_dl;
 static void sigasync(int sig, siginfo_t *si, void *uc);
 static void sigasync_std(int sig, siginfo_t *si, void *uc);
 static void leavedos_sig(int sig);
@@ -914,6 +917,8 @@ signal_init(void)
   coopth_set_permanent_post_handler(sh_tid, signal_thr_post);
   coopth_set_detached(sh_tid);
 
+  tick_dl = deadline_register(periodic_tick, NULL, "tick");
+
   /* unblock async signals in main thread */
   pthread_sigmask(SIG_UNBLOCK, &q_mask, NULL);
 }
@@ -926,6 +931,7 @@ void signal_done(void)
     itv.it_value = itv.it_interval;
     if (setitimer(ITIMER_REAL, &itv, NULL) == -1)
 	g_printf("can't turn off timer at shutdown: %s\n", strerror(errno));
+    deadline_done();
     registersig(SIGALRM, NULL);
     registersig(SIGIO, NULL);
     registersig(SIGCHLD, NULL);
@@ -978,8 +984,10 @@ void handle_signals(void)
 
 /* ==============================================================
  *
- * This is called by default at around 100Hz.
- * (see timer_interrupt_init() in init.c)
+ * The periodic housekeeping: screen refresh, polling of the devices
+ * registered with sigalrm_register_handler(), lost SIGIOs etc.
+ * It runs from the deadline scheduler at around 100Hz while the guest
+ * is busy and stretches to TICK_IDLE_PERIOD while it sleeps.
  *
  * The actual formulas, starting with the configurable parameter
  * config.freq, are:
@@ -991,13 +999,31 @@ void handle_signals(void)
  *
  * 6 is the magical TIMER_DIVISOR macro used to get 100Hz
  *
- * This call should NOT be used if you need timing accuracy - many
- * signals can get lost e.g. when kernel accesses disk, and the whole
- * idea of timing-by-counting is plain wrong. We'll need the Pentium
- * counter here.
+ * This call should NOT be used if you need timing accuracy - register
+ * your own deadline for that, see deadline.h.
  * ============================================================== */
 
+#define TICK_IDLE_PERIOD 200000
+
+/* SDL only gets its events when polled from update_screen() */
+static int tick_can_stretch(void *arg)
+{
+  return !(video_initialized && Video && Video->handle_events) &&
+    !config.pre_stroke;
+}
+
+void signal_start_tick(int period)
+{
+  deadline_set_periodic(tick_dl, period, TICK_IDLE_PERIOD, tick_can_stretch);
+  deadline_start();
+}
+
 static void SIGALRM_call(void *arg)
+{
+  deadline_run();
+}
+
+static void periodic_tick(void *arg)
 {
   static int first = 0;
   static hitimer_t cnt200 = 0;
@@ -1238,6 +1264,8 @@ static void process_callbacks(void)
 static void async_call(void *arg)
 {
   process_callbacks();
+  /* some thread has news for us */
+  deadline_kick();
 }
 
 static int saved_fc;
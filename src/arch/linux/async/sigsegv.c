@@ -25,6 +25,7 @@
 #include "cpu-emu.h"
 #include "dosemu_config.h"
 #include "sig.h"
+#include "disks.h"
 
 /*
  * All of the functions in this module need to be declared with
@@ -73,6 +74,9 @@ static void dosemu_fault1(int signal, sigcontext_t *scp)
     }
     goto bad;
   }
+  /* a mapped disk image got truncated, see disks.c */
+  if (signal == SIGBUS && disk_mmap_fault((void *)_cr2))
+    return;
 #ifdef __x86_64__
   if (_trapno == 0x0e && _cr2 > 0xffffffff)
   {
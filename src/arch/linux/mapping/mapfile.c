@@ -43,7 +43,7 @@ static void *alias_mapping_file(int cap, void *target, size_t mapsize, int prote
   off_t offs = (char *)source - mpool;
   void *addr;
 
-  if (offs < 0 || (offs+mapsize >= (mpool_numpages*PAGE_SIZE))) {
+  if (offs < 0 || (offs+mapsize > (mpool_numpages*PAGE_SIZE))) {
     Q_printf("MAPPING: alias_map to address outside of temp file\n");
     errno = EINVAL;
     return MAP_FAILED;
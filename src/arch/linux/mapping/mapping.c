@@ -79,40 +79,72 @@ static struct mappingdrivers *mappingdrv[] = {
 
 static struct mappingdrivers *mappingdriver;
 
-/* The alias map is used to track alias mappings from the first 1MB + HMA
-   to the corresponding addresses in Linux address space (either lowmem,
-   vgaemu, or EMS). The DOS address (&mem_base[address]) may be r/w
-   protected by cpuemu or vgaemu, but the alias is never protected,
-   so it can be used to write without needing to unprotect and reprotect
-   afterwards.
-   If the alias is not used (hardware RAM from /dev/mem, or DPMI memory
-   (aliasing using fn 0x509 is safely ignored here)),
-   the address is identity-mapped to &mem_base[address].
+/* With $_hugepages, the DPMI pool and extended memory are 2Mb-aligned
+   and marked for transparent huge pages. Any 4K mprotect() or remap
+   inside such a region (SetPageAttributes, uncommit) just makes the
+   kernel split the huge page, so nothing else has to care. */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+static int huge_pages;
+
+/* The alias map is used to track alias mappings in the whole 32bit DOS
+   address space to the corresponding addresses in Linux address space
+   (lowmem, vgaemu including the LFB, EMS, DPMI fn 0x509 or hardware RAM).
+   The DOS address (&mem_base[address]) may be r/w protected by cpuemu or
+   vgaemu, but the alias is never protected, so it can be used to write
+   without needing to unprotect and reprotect afterwards.
+   If there is no alias, the address is identity-mapped to
+   &mem_base[address]. The map is a directory of lazily allocated leaves
+   of 4Mb each, so that the lookup is two loads whatever the address.
 */
-static unsigned char *aliasmap[(LOWMEM_SIZE+HMASIZE)/PAGE_SIZE];
+#define ALIAS_LEAF_SHIFT 10
+#define ALIAS_LEAF_SIZE (1 << ALIAS_LEAF_SHIFT)
+#define ALIAS_DIR_SIZE (1 << (32 - PAGE_SHIFT - ALIAS_LEAF_SHIFT))
+static unsigned char **aliasmap[ALIAS_DIR_SIZE];
 
 static void update_aliasmap(dosaddr_t dosaddr, size_t mapsize,
 			    unsigned char *unixaddr)
 {
   unsigned int dospage, i;
 
-  if (dosaddr >= LOWMEM_SIZE+HMASIZE)
-    return;
   dospage = dosaddr >> PAGE_SHIFT;
-  for (i = 0; i < mapsize >> PAGE_SHIFT; i++)
-    aliasmap[dospage + i] = unixaddr ? unixaddr + (i << PAGE_SHIFT) : NULL;
+  for (i = 0; i < mapsize >> PAGE_SHIFT; i++) {
+    unsigned int page = dospage + i;
+    unsigned char ***leaf;
+    unsigned char *alias = NULL;
+
+    if (page >= ALIAS_DIR_SIZE * ALIAS_LEAF_SIZE)
+      break;
+    /* identity mappings are not aliases */
+    if (unixaddr && unixaddr != MEM_BASE32(dosaddr))
+      alias = unixaddr + (i << PAGE_SHIFT);
+    leaf = &aliasmap[page >> ALIAS_LEAF_SHIFT];
+    if (!*leaf) {
+      if (!alias)
+        continue;
+      *leaf = calloc(ALIAS_LEAF_SIZE, sizeof(**leaf));
+      if (!*leaf) {
+        error("MAPPING: no memory for the alias map\n");
+        return;
+      }
+    }
+    (*leaf)[page & (ALIAS_LEAF_SIZE - 1)] = alias;
+  }
 }
 
 void *dosaddr_to_unixaddr(unsigned int addr)
 {
-  if (addr < LOWMEM_SIZE + HMASIZE && aliasmap[addr >> PAGE_SHIFT])
-    return aliasmap[addr >> PAGE_SHIFT] + (addr & (PAGE_SIZE - 1));
+  unsigned int page = addr >> PAGE_SHIFT;
+  unsigned char **leaf = aliasmap[page >> ALIAS_LEAF_SHIFT];
+
+  if (leaf && leaf[page & (ALIAS_LEAF_SIZE - 1)])
+    return leaf[page & (ALIAS_LEAF_SIZE - 1)] + (addr & (PAGE_SIZE - 1));
   return MEM_BASE32(addr);
 }
 
 void *physaddr_to_unixaddr(unsigned int addr)
 {
-  if (addr < LOWMEM_SIZE + HMASIZE)
+  if (addr < LOWMEM_SIZE + HMASIZE || !ext_mem_base ||
+      addr >= LOWMEM_SIZE + HMASIZE + EXTMEM_SIZE)
     return dosaddr_to_unixaddr(addr);
   /* XXX something other than XMS? */
   return &ext_mem_base[addr - (LOWMEM_SIZE + HMASIZE)];
@@ -244,6 +276,14 @@ void *alias_mapping_high(int cap, size_t mapsize, int protect, void *source)
   target = mappingdriver->alias(cap, target, mapsize, protect, source);
   if (target == MAP_FAILED)
     return target;
+  /* the LFB is seen by DOS at its host address, so writes to it must
+   * go to the unprotected source */
+  if (cap & MAPPING_VGAEMU) {
+    dosaddr_t targ = DOSADDR_REL(target);
+
+    if (MEM_BASE32(targ) == target)
+      update_aliasmap(targ, mapsize, source);
+  }
   if (config.cpu_vm == CPUVM_KVM || config.cpu_vm_dpmi == CPUVM_KVM)
     mmap_kvm(cap, target, mapsize, protect);
   return target;
@@ -357,6 +397,26 @@ static int mapping_is_hole(void *start, size_t size)
   return (mapping_find_hole(beg, end, size) == start);
 }
 
+/* over-allocate and trim, so that the guest addresses and the host
+   addresses are congruent modulo the huge page size */
+static void *mmap_huge_aligned(size_t mapsize, int protect, int flags)
+{
+  unsigned char *addr, *aligned;
+  size_t head;
+
+  addr = mmap(NULL, mapsize + HUGE_PAGE_SIZE, protect,
+		MAP_PRIVATE | flags | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED)
+    return addr;
+  aligned = (unsigned char *)(((uintptr_t)addr + HUGE_PAGE_SIZE - 1) &
+		~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+  head = aligned - addr;
+  if (head)
+    munmap(addr, head);
+  munmap(aligned + mapsize, HUGE_PAGE_SIZE - head);
+  return aligned;
+}
+
 static void *do_mmap_mapping(int cap, void *target, size_t mapsize, int protect)
 {
   void *addr;
@@ -382,10 +442,18 @@ static void *do_mmap_mapping(int cap, void *target, size_t mapsize, int protect)
       (cap & (MAPPING_DPMI|MAPPING_VGAEMU|MAPPING_INIT_LOWRAM|MAPPING_KVM)))
     flags = MAP_32BIT;
 #endif
-  addr = mmap(target, mapsize, protect,
+  if (huge_pages && !target && !(flags & MAP_FIXED) &&
+      (cap & (MAPPING_DPMI|MAPPING_EXTMEM|MAPPING_INIT_LOWRAM)))
+    addr = mmap_huge_aligned(mapsize, protect, flags);
+  else
+    addr = mmap(target, mapsize, protect,
 		MAP_PRIVATE | flags | MAP_ANONYMOUS, -1, 0);
   if (addr == MAP_FAILED)
     return addr;
+#ifdef MADV_HUGEPAGE
+  if (huge_pages && (cap & (MAPPING_DPMI|MAPPING_EXTMEM)))
+    madvise(addr, mapsize, MADV_HUGEPAGE);
+#endif
   if (cap & MAPPING_NOOVERLAP) {
 #ifdef MAP_FIXED_NOREPLACE
 #ifdef __linux__
@@ -487,6 +555,36 @@ int mprotect_mapping(int cap, dosaddr_t targ, size_t mapsize, int protect)
   return ret;
 }
 
+static int thp_available(void)
+{
+#ifdef MADV_HUGEPAGE
+  char buf[128];
+  const char *mode = "unknown";
+  int fd, len;
+
+  fd = open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    error("MAPPING: transparent huge pages not supported by the kernel\n");
+    return 0;
+  }
+  len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len > 0) {
+    buf[len] = 0;
+    if (strstr(buf, "[never]")) {
+      error("MAPPING: transparent huge pages are disabled on the host\n");
+      return 0;
+    }
+    mode = strstr(buf, "[always]") ? "always" : "madvise";
+  }
+  c_printf("MAPPING: using transparent huge pages (%s)\n", mode);
+  return 1;
+#else
+  error("MAPPING: huge pages not supported by this build\n");
+  return 0;
+#endif
+}
+
 /*
  * This gets called on DOSEMU startup to determine the kind of mapping
  * and setup the appropriate function pointers
@@ -532,6 +630,25 @@ void mapping_init(void)
 
   for (i = 0; i < MAX_BASES; i++)
     mem_bases[i] = MAP_FAILED;
+
+  if (config.hugepages)
+    huge_pages = thp_available();
+}
+
+/* log how much of a region can be backed by huge pages */
+void mapping_huge_coverage(const char *name, void *addr, size_t size)
+{
+  uintptr_t beg, end;
+  size_t huge = 0;
+
+  if (!huge_pages || !size)
+    return;
+  beg = ((uintptr_t)addr + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+  end = ((uintptr_t)addr + size) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+  if (end > beg)
+    huge = end - beg;
+  c_printf("MAPPING: %s: %zuK of %zuK (%zu%%) eligible for huge pages\n",
+	name, huge >> 10, size >> 10, huge * 100 / size);
 }
 
 /* this gets called on DOSEMU termination cleanup all mapping stuff */
@@ -680,6 +797,7 @@ int munmap_mapping(int cap, dosaddr_t targ, size_t mapsize)
     dosemu_error("Found %i kmem mappings at %#x\n", ku, targ);
 
   munmap(MEM_BASE32(targ), mapsize);
+  update_aliasmap(targ, mapsize, NULL);
   if (config.cpu_vm == CPUVM_KVM || config.cpu_vm_dpmi == CPUVM_KVM)
     munmap_kvm(cap, targ, mapsize);
   return 0;
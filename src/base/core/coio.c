@@ -0,0 +1,260 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: run blocking host I/O in worker threads.
+ *
+ * A coopth thread that has to wait for the disk hands the job to a
+ * worker and goes to sleep, so timers, IRQs and sound keep running in
+ * the meantime. The worker wakes it up through add_thread_callback().
+ * Outside of a coopth thread the job is simply run in place.
+ *
+ * Requests are refcounted: the caller holds one reference, a submitted
+ * request holds another until the completion callback. This way a
+ * caller that gets cancelled while sleeping never leaves the worker
+ * with a dangling buffer. The refcount is only touched by the main
+ * thread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "emu.h"
+#include "coopth.h"
+#include "sig.h"
+#include "dos2linux.h"
+#include "coio.h"
+
+#define COIO_WORKERS 2
+
+struct coio_req {
+  coio_func_t func;
+  int tid;
+  int refs;
+  int done;
+  /* cleanup handler of the caller, chained while we sleep */
+  coopth_func_t clnup;
+  void *clnup_arg;
+  struct coio_req *next;
+  /* the payload must be suitably aligned for any type */
+  long double data[];
+};
+
+static pthread_once_t coio_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t req_mtx = PTHREAD_MUTEX_INITIALIZER;
+static sem_t req_sem;
+static struct coio_req *req_head, *req_tail;
+static int coio_ok;
+
+#define REQ(arg) ((struct coio_req *)((char *)(arg) - \
+    offsetof(struct coio_req, data)))
+
+static void *coio_thread(void *arg);
+
+static void coio_init(void)
+{
+  pthread_t thr;
+  int i;
+
+  sem_init(&req_sem, 0, 0);
+  for (i = 0; i < COIO_WORKERS; i++) {
+    if (pthread_create(&thr, NULL, coio_thread, NULL) != 0) {
+      error("coio: can't create worker: %s\n", strerror(errno));
+      break;
+    }
+    pthread_detach(thr);
+#if defined(HAVE_PTHREAD_SETNAME_NP) && defined(__GLIBC__)
+    pthread_setname_np(thr, "dosemu: io");
+#endif
+    coio_ok = 1;
+  }
+}
+
+void *coio_alloc(size_t size)
+{
+  struct coio_req *req = malloc(sizeof(*req) + size);
+
+  if (!req)
+    return NULL;
+  req->refs = 1;
+  return req->data;
+}
+
+void coio_free(void *arg)
+{
+  struct coio_req *req = REQ(arg);
+
+  if (--req->refs == 0)
+    free(req);
+}
+
+static void coio_done(void *arg)
+{
+  struct coio_req *req = arg;
+
+  req->done = 1;
+  /* the caller is gone if it was cancelled while sleeping */
+  if (req->refs > 1)
+    coopth_wake_up(req->tid);
+  coio_free(req->data);
+}
+
+static void *coio_thread(void *arg)
+{
+  struct coio_req *req;
+
+  while (1) {
+    sem_wait(&req_sem);
+    pthread_mutex_lock(&req_mtx);
+    req = req_head;
+    req_head = req->next;
+    if (!req_head)
+      req_tail = NULL;
+    pthread_mutex_unlock(&req_mtx);
+
+    req->func(req->data);
+    add_thread_callback(coio_done, req, "coio");
+  }
+  return NULL;
+}
+
+/* called from coopth when the thread is already asleep, so the wakeup
+ * can't come too early */
+static void coio_submit(void *arg)
+{
+  struct coio_req *req = arg;
+
+  req->next = NULL;
+  pthread_mutex_lock(&req_mtx);
+  if (req_tail)
+    req_tail->next = req;
+  else
+    req_head = req;
+  req_tail = req;
+  pthread_mutex_unlock(&req_mtx);
+  sem_post(&req_sem);
+}
+
+static void coio_cancelled(void *arg)
+{
+  struct coio_req *req = REQ(arg);
+  coopth_func_t clnup = req->clnup;
+  void *clnup_arg = req->clnup_arg;
+
+  coio_free(arg);
+  if (clnup)
+    clnup(clnup_arg);
+}
+
+void coio_run(coio_func_t func, void *arg)
+{
+  struct coio_req *req = REQ(arg);
+  int iflg;
+
+  if (coopth_is_in_thread())
+    pthread_once(&coio_once, coio_init);
+  if (!coio_ok || !coopth_is_in_thread()) {
+    func(arg);
+    return;
+  }
+
+  req->func = func;
+  req->tid = coopth_get_tid();
+  req->done = 0;
+  req->refs++;
+  coopth_set_sleep_handler(coio_submit, req);
+  coopth_get_cleanup_handler(&req->clnup, &req->clnup_arg);
+  coopth_set_cleanup_handler(coio_cancelled, arg);
+  /* real BIOSes also do sti while waiting for the controller */
+  iflg = isset_IF();
+  if (!iflg)
+    set_IF();
+  coopth_sleep();
+  while (!req->done)
+    coopth_sleep();
+  if (!iflg)
+    clear_IF();
+  coopth_set_cleanup_handler(req->clnup, req->clnup_arg);
+}
+
+struct coio_rw {
+  int fd;
+  int cnt;
+  int ret;
+  int err;
+  unsigned char buf[];
+};
+
+static void coio_read_thr(void *arg)
+{
+  struct coio_rw *rw = arg;
+  rw->ret = RPT_SYSCALL(read(rw->fd, rw->buf, rw->cnt));
+  rw->err = errno;
+}
+
+static void coio_write_thr(void *arg)
+{
+  struct coio_rw *rw = arg;
+  rw->ret = RPT_SYSCALL(write(rw->fd, rw->buf, rw->cnt));
+  rw->err = errno;
+}
+
+/* dos_read()/dos_write() that don't block the DOS side */
+int coio_dos_read(int fd, unsigned data, int cnt)
+{
+  struct coio_rw *rw;
+  int ret;
+
+  if (cnt <= 0)
+    return dos_read(fd, data, cnt);
+  rw = coio_alloc(sizeof(*rw) + cnt);
+  if (!rw)
+    return dos_read(fd, data, cnt);
+  rw->fd = fd;
+  rw->cnt = cnt;
+  coio_run(coio_read_thr, rw);
+  ret = rw->ret;
+  if (ret > 0)
+    memcpy_2dos(data, rw->buf, ret);
+  else if (ret < 0)
+    errno = rw->err;
+  coio_free(rw);
+  return ret;
+}
+
+int coio_dos_write(int fd, unsigned data, int cnt)
+{
+  struct coio_rw *rw;
+  int ret;
+
+  if (cnt <= 0)
+    return dos_write(fd, data, cnt);
+  rw = coio_alloc(sizeof(*rw) + cnt);
+  if (!rw)
+    return dos_write(fd, data, cnt);
+  rw->fd = fd;
+  rw->cnt = cnt;
+  memcpy_2unix(rw->buf, data, cnt);
+  coio_run(coio_write_thr, rw);
+  ret = rw->ret;
+  if (ret < 0)
+    errno = rw->err;
+  coio_free(rw);
+  return ret;
+}
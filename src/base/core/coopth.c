@@ -101,9 +101,9 @@ struct coopth_per_thread_t {
     struct coopth_thrdata_t data;
     struct coopth_starter_args_t args;
     void *stack;
-    size_t stk_size;
     Bit16u ret_cs, ret_ip;
-    int quick_sched:1;
+    int quick_sched:1;		/* on the run queue */
+    struct coopth_per_thread_t *rq_prev, *rq_next;
     uint64_t dbg;
 };
 
@@ -116,7 +116,6 @@ struct coopth_t {
     int off;
     int len;
     int cur_thr;
-    int max_thr;
     int detached:1;
     struct coopth_ctx_handlers_t ctxh;
     struct coopth_sleep_handlers_t sleeph;
@@ -149,12 +148,90 @@ static void do_call_post(struct coopth_t *thr,
 	struct coopth_per_thread_t *pth);
 
 #define COOP_STK_SIZE() (512 * getpagesize())
+/* that many free stacks are kept around for reuse */
+#define COOP_STK_POOL 16
+static void *stk_pool[COOP_STK_POOL];
+static int stk_pool_num;
+
+/* detached threads woken up since the last coopth_run() */
+static struct coopth_per_thread_t *runq_head, *runq_tail;
 
 void coopth_init(void)
 {
     co_handle = co_thread_init(PCL_C_MC);
 }
 
+/* The stacks are not tied to the tids: they are taken from the pool
+ * on start and returned when the thread is deleted, so only as many
+ * of them exist as there are threads running at once. Each one has
+ * an inaccessible page below it. libpcl keeps its coroutine struct at
+ * the stack base, so an overflow clobbers that first: the guard page
+ * only stops it from running on into the neighbouring mapping. */
+static void *stk_get(void)
+{
+    size_t pgsz = getpagesize();
+    void *stk;
+
+    if (stk_pool_num)
+	return stk_pool[--stk_pool_num];
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+    stk = mmap(NULL, COOP_STK_SIZE() + pgsz, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stk == MAP_FAILED)
+	return NULL;
+    if (mprotect(stk, pgsz, PROT_NONE) == -1) {
+	munmap(stk, COOP_STK_SIZE() + pgsz);
+	return NULL;
+    }
+    return (char *)stk + pgsz;
+}
+
+static void stk_free(void *stk)
+{
+    size_t pgsz = getpagesize();
+
+    munmap((char *)stk - pgsz, COOP_STK_SIZE() + pgsz);
+}
+
+static void stk_put(void *stk)
+{
+    if (stk_pool_num < COOP_STK_POOL)
+	stk_pool[stk_pool_num++] = stk;
+    else
+	stk_free(stk);
+}
+
+static void runq_add(struct coopth_per_thread_t *pth)
+{
+    if (pth->quick_sched)
+	return;
+    pth->quick_sched = 1;
+    pth->rq_next = NULL;
+    pth->rq_prev = runq_tail;
+    if (runq_tail)
+	runq_tail->rq_next = pth;
+    else
+	runq_head = pth;
+    runq_tail = pth;
+}
+
+static void runq_del(struct coopth_per_thread_t *pth)
+{
+    if (!pth->quick_sched)
+	return;
+    pth->quick_sched = 0;
+    if (pth->rq_prev)
+	pth->rq_prev->rq_next = pth->rq_next;
+    else
+	runq_head = pth->rq_next;
+    if (pth->rq_next)
+	pth->rq_next->rq_prev = pth->rq_prev;
+    else
+	runq_tail = pth->rq_prev;
+}
+
 #define SW_ST(x) (struct coopth_state_t){ COOPTHS_SWITCH, idx_##x }
 #define ST(x) (struct coopth_state_t){ COOPTHS_##x, idx_NONE }
 
@@ -277,6 +354,10 @@ static void do_del_thread(struct coopth_t *thr,
 {
     int i;
     pth->st = ST(NONE);
+    runq_del(pth);
+    /* the coroutine has exited, nothing runs on that stack any more */
+    stk_put(pth->stack);
+    pth->stack = NULL;
     thr->cur_thr--;
     if (thr->cur_thr == 0) {
 	int found = 0;
@@ -619,20 +700,11 @@ static int do_start(struct coopth_t *thr, struct coopth_state_t st,
     }
     tn = thr->cur_thr++;
     pth = &thr->pth[tn];
-    if (thr->cur_thr > thr->max_thr) {
-	size_t stk_size = COOP_STK_SIZE();
-	thr->max_thr = thr->cur_thr;
-#ifndef MAP_STACK
-#define MAP_STACK 0
-#endif
-	pth->stack = mmap(NULL, stk_size, PROT_READ | PROT_WRITE,
-		MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
-	if (pth->stack == MAP_FAILED) {
-	    error("Unable to allocate stack\n");
-	    leavedos(21);
-	    return 1;
-	}
-	pth->stk_size = stk_size;
+    pth->stack = stk_get();
+    if (!pth->stack) {
+	error("Unable to allocate stack\n");
+	leavedos(21);
+	return 1;
     }
     pth->data.tid = &thr->tid;
     pth->data.attached = 0;
@@ -651,7 +723,7 @@ static int do_start(struct coopth_t *thr, struct coopth_state_t st,
     pth->quick_sched = 0;
     pth->dbg = dbg;	// for debug
     pth->thread = co_create(co_handle, coopth_thread, &pth->args, pth->stack,
-	    pth->stk_size);
+	    COOP_STK_SIZE());
     if (!pth->thread) {
 	error("Thread create failure\n");
 	leavedos(2);
@@ -815,11 +887,9 @@ int coopth_unsafe_detach(int tid, const char *who)
     return 0;
 }
 
-static int run_traverser(int (*pred)(struct coopth_per_thread_t *, void*),
-	void *pred_arg, void (*post)(struct coopth_per_thread_t *))
+static void run_traverser(void)
 {
     int i;
-    int cnt = 0;
     for (i = 0; i < threads_active; i++) {
 	int tid = active_tids[i];
 	struct coopth_t *thr = &coopthreads[tid];
@@ -832,33 +902,27 @@ static int run_traverser(int (*pred)(struct coopth_per_thread_t *, void*),
 		error("coopth: switching to left thread?\n");
 	    continue;
 	}
-	if (pred && !pred(pth, pred_arg))
-	    continue;
+	runq_del(pth);
 	thread_run(thr, pth);
-	if (post)
-	    post(pth);
-	cnt++;
     }
-    return cnt;
-}
-
-static int quick_sched_pred(struct coopth_per_thread_t *pth, void *arg)
-{
-    return pth->quick_sched;
-}
-
-static void quick_sched_post(struct coopth_per_thread_t *pth)
-{
-    pth->quick_sched = 0;
 }
 
 void coopth_run(void)
 {
+    struct coopth_per_thread_t *pth;
+
     assert(DETACHED_RUNNING >= 0);
     if (DETACHED_RUNNING)
 	return;
-    run_traverser(NULL, NULL, NULL);
-    while (run_traverser(quick_sched_pred, NULL, quick_sched_post));
+    run_traverser();
+    /* then whatever got woken up meanwhile, without rescanning */
+    while ((pth = runq_head)) {
+	struct coopth_t *thr = &coopthreads[*pth->data.tid];
+	runq_del(pth);
+	if (pth->data.attached || pth->data.left)
+	    continue;
+	thread_run(thr, pth);
+    }
 }
 
 void coopth_run_tid(int tid)
@@ -895,6 +959,11 @@ int coopth_get_tid(void)
     return *thdata->tid;
 }
 
+int coopth_is_in_thread(void)
+{
+    return _coopth_is_in_thread_nowarn();
+}
+
 int coopth_add_post_handler(coopth_func_t func, void *arg)
 {
     struct coopth_thrdata_t *thdata;
@@ -927,6 +996,16 @@ int coopth_set_cleanup_handler(coopth_func_t func, void *arg)
     return 0;
 }
 
+int coopth_get_cleanup_handler(coopth_func_t *func, void **arg)
+{
+    struct coopth_thrdata_t *thdata;
+    assert(_coopth_is_in_thread());
+    thdata = co_get_data(co_current(co_handle));
+    *func = thdata->clnup.func;
+    *arg = thdata->clnup.arg;
+    return 0;
+}
+
 void coopth_push_user_data(int tid, void *udata)
 {
     struct coopth_t *thr;
@@ -1202,7 +1281,7 @@ static void do_awake(struct coopth_per_thread_t *pth)
     }
     pth->st = SW_ST(AWAKEN);
     if (!pth->data.attached)
-	pth->quick_sched = 1;	// optimize DPMI switches
+	runq_add(pth);	// optimize DPMI switches
 }
 
 void coopth_wake_up(int tid)
@@ -1358,17 +1437,9 @@ again:
      * except perhaps current one */
     assert(threads_total == threads_joinable + itd);
 
-    for (i = 0; i < coopth_num; i++) {
-	struct coopth_t *thr = &coopthreads[i];
-	int j;
-	/* dont free own thread */
-	if (thdata && *thdata->tid == i)
-	    continue;
-	for (j = thr->cur_thr; j < thr->max_thr; j++) {
-	    struct coopth_per_thread_t *pth = &thr->pth[j];
-	    munmap(pth->stack, pth->stk_size);
-	}
-    }
+    /* the stacks of the threads still running are leaked */
+    while (stk_pool_num)
+	stk_free(stk_pool[--stk_pool_num]);
     if (!threads_total)
 	co_thread_cleanup(co_handle);
     else
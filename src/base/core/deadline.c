@@ -0,0 +1,355 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: tickless timer core.
+ *
+ * Every timed activity (PIT/PIC interrupts, RTC, sound, the periodic
+ * housekeeping in signal.c) registers its next expiry here. The
+ * entries are kept in a min-heap and a single one-shot ITIMER_REAL is
+ * armed for the earliest one, so SIGALRM only comes when something is
+ * actually due. It has to be a signal rather than a timerfd: the
+ * guest code must be preempted, and timerfd can't raise SIGIO.
+ *
+ * Periodic entries stretch to their idle period while the guest
+ * sleeps, and are pulled back by deadline_kick() when input arrives
+ * or the guest stays busy.
+ *
+ * Times are kept in usecs of CLOCK_MONOTONIC, so that the periodic
+ * entries also run when the DOS time is stopped.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <assert.h>
+#include "emu.h"
+#include "timers.h"
+#include "deadline.h"
+
+#define MAX_DEADLINES 16
+/* don't arm the host timer for less than that */
+#define DL_MIN_US 50
+/* guest running that long without a sleep counts as busy */
+#define DL_BUSY_US 10000
+
+struct deadline {
+  deadline_func_t func;
+  void *arg;
+  const char *name;
+  hitimer_t when;
+  int pos;			/* index in heap[], -1 if not queued */
+  /* periodic entries */
+  unsigned period;
+  unsigned idle_period;
+  int (*idle)(void *arg);
+  hitimer_t last;
+  hitimer_t slept;		/* sleep_total at last run */
+  int stretched;
+};
+
+static struct deadline dls[MAX_DEADLINES];
+static int num_dls;
+static int heap[MAX_DEADLINES];
+static int heap_len;
+
+static hitimer_t armed;		/* host timer expiry, 0 if not armed */
+static int started;
+static int blocked;
+static int in_sleep;
+static hitimer_t sleep_start, sleep_total, wake_time;
+static hitimer_t start_time;
+static unsigned long wakeups;
+
+static hitimer_t dl_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int dl_less(int a, int b)
+{
+  return dls[heap[a]].when < dls[heap[b]].when;
+}
+
+static void dl_swap(int a, int b)
+{
+  int t = heap[a];
+
+  heap[a] = heap[b];
+  heap[b] = t;
+  dls[heap[a]].pos = a;
+  dls[heap[b]].pos = b;
+}
+
+static void heap_up(int i)
+{
+  while (i > 0 && dl_less(i, (i - 1) / 2)) {
+    dl_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void heap_down(int i)
+{
+  while (1) {
+    int m = i, l = 2 * i + 1, r = l + 1;
+
+    if (l < heap_len && dl_less(l, m))
+      m = l;
+    if (r < heap_len && dl_less(r, m))
+      m = r;
+    if (m == i)
+      break;
+    dl_swap(i, m);
+    i = m;
+  }
+}
+
+static void heap_remove(int id)
+{
+  int i = dls[id].pos, moved;
+
+  if (i < 0)
+    return;
+  dls[id].pos = -1;
+  heap_len--;
+  if (i == heap_len)
+    return;
+  moved = heap[heap_len];
+  heap[i] = moved;
+  dls[moved].pos = i;
+  heap_up(i);
+  heap_down(dls[moved].pos);
+}
+
+static void heap_update(int id, hitimer_t when)
+{
+  struct deadline *d = &dls[id];
+
+  if (d->pos < 0) {
+    d->pos = heap_len;
+    heap[heap_len++] = id;
+    d->when = when;
+    heap_up(d->pos);
+    return;
+  }
+  if (when < d->when) {
+    d->when = when;
+    heap_up(d->pos);
+  } else if (when > d->when) {
+    d->when = when;
+    heap_down(d->pos);
+  }
+}
+
+/* (re)arm the host timer for the earliest entry. The timer firing
+ * early is harmless, so it is only touched when the new deadline
+ * is before the armed one. */
+static void dl_arm(void)
+{
+  struct itimerval itv = {};
+  hitimer_t when, now;
+  long long delta;
+
+  if (!started || blocked || !heap_len)
+    return;
+  when = dls[heap[0]].when;
+  if (armed && armed <= when)
+    return;
+  now = dl_now();
+  delta = when - now;
+  if (delta < DL_MIN_US)
+    delta = DL_MIN_US;
+  itv.it_value.tv_sec = delta / 1000000;
+  itv.it_value.tv_usec = delta % 1000000;
+  if (setitimer(ITIMER_REAL, &itv, NULL) == -1) {
+    error("deadline: setitimer failed: %s\n", strerror(errno));
+    return;
+  }
+  armed = now + delta;
+}
+
+int deadline_register(deadline_func_t func, void *arg, const char *name)
+{
+  struct deadline *d;
+
+  assert(num_dls < MAX_DEADLINES);
+  d = &dls[num_dls];
+  d->func = func;
+  d->arg = arg;
+  d->name = name;
+  d->pos = -1;
+  return num_dls++;
+}
+
+void deadline_set(int id, hitimer_t when)
+{
+  hitimer_t now = GETusTIME(0);
+  hitimer_t hnow = dl_now();
+
+  dls[id].period = 0;
+  heap_update(id, when > now ? hnow + (when - now) : hnow);
+  dl_arm();
+}
+
+void deadline_set_periodic(int id, unsigned period, unsigned idle_period,
+	int (*idle)(void *arg))
+{
+  struct deadline *d = &dls[id];
+
+  if (!period) {
+    deadline_cancel(id);
+    return;
+  }
+  d->idle_period = idle_period;
+  d->idle = idle;
+  if (d->period && d->pos >= 0) {
+    d->period = period;
+    return;
+  }
+  d->period = period;
+  d->last = dl_now();
+  d->slept = sleep_total;
+  d->stretched = 0;
+  if (d->pos < 0) {
+    heap_update(id, d->last + period);
+    dl_arm();
+  }
+}
+
+void deadline_cancel(int id)
+{
+  dls[id].period = 0;
+  heap_remove(id);
+}
+
+/* something happened that wants the periodic entries at full rate */
+void deadline_kick(void)
+{
+  int i, upd = 0;
+
+  for (i = 0; i < num_dls; i++) {
+    struct deadline *d = &dls[i];
+    hitimer_t when;
+
+    if (!d->period || !d->stretched)
+      continue;
+    d->stretched = 0;
+    when = d->last + d->period;
+    if (d->pos >= 0 && when < d->when) {
+      heap_update(i, when);
+      upd++;
+    }
+  }
+  if (upd)
+    dl_arm();
+}
+
+/* called around the host sleep of the main thread */
+void deadline_sleep(int on)
+{
+  hitimer_t now = dl_now();
+
+  if (on) {
+    in_sleep = 1;
+    sleep_start = now;
+  } else if (in_sleep) {
+    in_sleep = 0;
+    sleep_total += now - sleep_start;
+    wake_time = now;
+  }
+}
+
+/* for the code that can't stand SIGALRM for a while */
+void deadline_block(int on)
+{
+  struct itimerval itv = {};
+
+  if (on) {
+    if (!blocked++) {
+      setitimer(ITIMER_REAL, &itv, NULL);
+      armed = 0;
+    }
+  } else if (blocked && !--blocked) {
+    dl_arm();
+  }
+}
+
+void deadline_start(void)
+{
+  started = 1;
+  start_time = dl_now();
+  dl_arm();
+}
+
+static void dl_rearm_periodic(int id, hitimer_t now)
+{
+  struct deadline *d = &dls[id];
+  unsigned period = d->period;
+  hitimer_t next;
+
+  /* mostly asleep since the last run, and the owner doesn't object */
+  if (d->idle_period && sleep_total - d->slept >= (now - d->last) / 2 &&
+      (!d->idle || d->idle(d->arg)))
+    period = d->idle_period;
+  d->stretched = (period != d->period);
+  d->last = now;
+  d->slept = sleep_total;
+  next = d->when + period;
+  if (next <= now)
+    next = now + period;
+  heap_update(id, next);
+}
+
+/* SIGALRM: run everything that is due */
+void deadline_run(void)
+{
+  hitimer_t now = dl_now();
+  int n;
+
+  armed = 0;
+  wakeups++;
+  /* guest was running for a whole tick: stop stretching */
+  if (!in_sleep && now - wake_time >= DL_BUSY_US)
+    deadline_kick();
+  /* bounded, in case a handler keeps re-queueing itself as due */
+  for (n = 0; heap_len && n < MAX_DEADLINES; n++) {
+    int id = heap[0];
+    struct deadline *d = &dls[id];
+
+    if (d->when > now)
+      break;
+    heap_remove(id);
+    d->func(d->arg);
+    if (d->period && d->pos < 0)
+      dl_rearm_periodic(id, now);
+  }
+  dl_arm();
+}
+
+void deadline_done(void)
+{
+  hitimer_t t = dl_now() - start_time;
+
+  if (!started || !t)
+    return;
+  g_printf("TIMER: %lu host timer wakeups, %.1f/s\n", wakeups,
+      wakeups * 1000000.0 / t);
+}
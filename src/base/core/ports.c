@@ -514,7 +514,11 @@ int port_rep_inb(ioport_t port, Bit8u *base, int df, Bit32u count)
 	if (count==0) return 0;
 	i_printf("Doing REP insb(%#x) %d bytes at %p, DF %d\n", port,
 		count, base, df);
-	if (EMU_HANDLER(port).read_portb == std_port_inb) {
+	if (!df && EMU_HANDLER(port).rep.rep_inb) {
+	    EMU_HANDLER(port).rep.rep_inb(port, dest, count);
+	    dest += count;
+	}
+	else if (EMU_HANDLER(port).read_portb == std_port_inb) {
 	    while (count--) {
 	      *dest = std_port_inb(port);
 	      dest += incr;
@@ -545,7 +549,11 @@ int port_rep_outb(ioport_t port, Bit8u *base, int df, Bit32u count)
 	if (count==0) return 0;
 	i_printf("Doing REP outsb(%#x) %d bytes at %p, DF %d\n", port,
 		count, base, df);
-	if (EMU_HANDLER(port).write_portb == std_port_outb) {
+	if (!df && EMU_HANDLER(port).rep.rep_outb) {
+	    EMU_HANDLER(port).rep.rep_outb(port, dest, count);
+	    dest += count;
+	}
+	else if (EMU_HANDLER(port).write_portb == std_port_outb) {
 	    while (count--) {
 	      std_port_outb(port, *dest);
 	      dest += incr;
@@ -576,7 +584,11 @@ int port_rep_inw(ioport_t port, Bit16u *base, int df, Bit32u count)
 	if (count==0) return 0;
 	i_printf("Doing REP insw(%#x) %d words at %p, DF %d\n", port,
 		count, base, df);
-	if (EMU_HANDLER(port).read_portw == std_port_inw) {
+	if (!df && EMU_HANDLER(port).rep.rep_inw) {
+	    EMU_HANDLER(port).rep.rep_inw(port, dest, count);
+	    dest += count;
+	}
+	else if (EMU_HANDLER(port).read_portw == std_port_inw) {
 	    while (count--) {
 	      *dest = std_port_inw(port);
 	      dest += incr;
@@ -615,7 +627,11 @@ int port_rep_outw(ioport_t port, Bit16u *base, int df, Bit32u count)
 	if (count==0) return 0;
 	i_printf("Doing REP outsw(%#x) %d words at %p, DF %d\n", port,
 		count, base, df);
-	if (EMU_HANDLER(port).write_portw == std_port_outw) {
+	if (!df && EMU_HANDLER(port).rep.rep_outw) {
+	    EMU_HANDLER(port).rep.rep_outw(port, dest, count);
+	    dest += count;
+	}
+	else if (EMU_HANDLER(port).write_portw == std_port_outw) {
 	    while (count--) {
 	      std_port_outw(port, *dest);
 	      dest += incr;
@@ -651,6 +667,14 @@ int port_rep_ind(ioport_t port, Bit32u *base, int df, Bit32u count)
 	Bit32u *dest = base;
 
 	if (count==0) return 0;
+	if (!df && EMU_HANDLER(port).rep.rep_ind) {
+	  EMU_HANDLER(port).rep.rep_ind(port, dest, count);
+	  while (count--) {
+	    (void)LOG_PORT_READ_D(port, *dest);
+	    dest++;
+	  }
+	  return (Bit8u *)dest-(Bit8u *)base;
+	}
 	while (count--) {
 	  *dest = port_ind(port);
 	  (void)LOG_PORT_READ_D(port, *dest);
@@ -665,6 +689,14 @@ int port_rep_outd(ioport_t port, Bit32u *base, int df, Bit32u count)
 	Bit32u *dest = base;
 
 	if (count==0) return 0;
+	if (!df && EMU_HANDLER(port).rep.rep_outd) {
+	  EMU_HANDLER(port).rep.rep_outd(port, dest, count);
+	  while (count--) {
+	    LOG_PORT_WRITE_D(port, *dest);
+	    dest++;
+	  }
+	  return (Bit8u *)dest-(Bit8u *)base;
+	}
 	while (count--) {
 	  port_outd(port, *dest);
 	  LOG_PORT_WRITE_D(port, *dest);
@@ -788,6 +820,7 @@ int port_init(void)
 	  port_handler[i].write_portw  = NULL;
 	  port_handler[i].read_portd   = NULL;
 	  port_handler[i].write_portd  = NULL;
+	  memset(&port_handler[i].rep, 0, sizeof(port_handler[i].rep));
 	  port_handler[i].irq = EMU_NO_IRQ;
 	  port_handler[i].fd = -1;
 	}
@@ -1082,6 +1115,7 @@ int port_register_handler(emu_iodev_t device, int flags)
 		(device.read_portd? : port_not_avail_ind);
 	port_handler[handle].write_portd =
 		(device.write_portd? : port_not_avail_outd);
+	memset(&port_handler[handle].rep, 0, sizeof(port_handler[handle].rep));
 	port_handler[handle].handler_name = device.handler_name;
 	port_handler[handle].irq = device.irq;
 	port_handler[handle].fd = -1;
@@ -1116,6 +1150,29 @@ int port_register_handler(emu_iodev_t device, int flags)
     return 0;
 }
 
+/*
+ * SIDOC_BEGIN_FUNCTION port_register_rep_handler
+ *
+ * Adds the bulk REP INS/OUTS handlers to the device that owns the port,
+ * so that a whole string transfer is a single call. The handlers get
+ * the actual port and can fall back to the single accesses for the
+ * ports they don't care about.
+ *
+ * SIDOC_END_FUNCTION
+ */
+int port_register_rep_handler(ioport_t port, const emu_iodev_rep_t *rep)
+{
+    int handle = port_handle_table[(Bit16u)port];
+
+    if (handle < STD_HANDLES) {
+	error("PORT: no device at %#x for the rep handlers\n", port);
+	return 1;
+    }
+    port_handler[handle].rep = *rep;
+    i_printf("PORT: registered rep handlers for \"%s\"\n",
+	port_handler[handle].handler_name);
+    return 0;
+}
 
 /*
  * SIDOC_BEGIN_FUNCTION port_allow_io
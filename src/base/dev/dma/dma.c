@@ -232,6 +232,84 @@ int dma_pulse_DRQ(int ch, Bit8u * buf)
     return ret;
 }
 
+/* Can a run of DRQ pulses on this channel be done as plain copies?
+ * Address decrement and hold, and the block and cascade modes, keep
+ * going through dma_pulse_DRQ(). */
+static int dma_burst_ok(int dma_idx, int chan_idx)
+{
+    struct dma_channel *chan = &dma[dma_idx].chans[chan_idx];
+    int mode = DMA_TRANSFER_MODE(chan->mode);
+    int op = DMA_TRANSFER_OP(chan->mode);
+
+    return (mode == SINGLE || mode == DEMAND) &&
+	(op == READ || op == WRITE) &&
+	!DMA_ADDR_DEC(chan->mode) &&
+	(dma[dma_idx].command & 3) != 3 &&
+	!(dma[dma_idx].command & 4) &&
+	!MASKED(dma_idx, chan_idx) &&
+	!REACHED_TC(dma_idx, chan_idx) &&
+	!(dma[dma_idx].status & 0xf0) && !dma[dma_idx].request;
+}
+
+/* Same as len / unit-size calls to dma_pulse_DRQ(), but each run up to
+ * TC, auto-init reload or the end of a host page is one memcpy().
+ * Returns the number of bytes transferred, which is less than len if
+ * the channel reached TC or got masked. */
+int dma_burst_DRQ(int ch, Bit8u * buf, int len)
+{
+    int di = DI(ch), ci = CI(ch);
+    struct dma_channel *chan = &dma[di].chans[ci];
+    int units = len >> di;
+    int done = 0;
+
+    if (!dma_burst_ok(di, ci)) {
+	while (done < units &&
+		dma_pulse_DRQ(ch, buf + (done << di)) == DMA_DACK)
+	    done++;
+	return done << di;
+    }
+
+    DMA_LOCK();
+    while (done < units) {
+	unsigned phys = (chan->page << 16) | (chan->cur_addr.value << di);
+	int n = units - done;
+	int pg = (PAGE_SIZE - (phys & (PAGE_SIZE - 1))) >> di;
+	void *addr = physaddr_to_unixaddr(phys);
+
+	if (n > chan->cur_count.value + 1)
+	    n = chan->cur_count.value + 1;
+	if (n > 0x10000 - chan->cur_addr.value)	/* address wraps in page */
+	    n = 0x10000 - chan->cur_addr.value;
+	if (pg > 0 && n > pg)
+	    n = pg;
+	if (DMA_TRANSFER_OP(chan->mode) == WRITE) {
+	    memcpy(addr, buf + (done << di), n << di);
+	} else {
+	    memcpy(buf + (done << di), addr, n << di);
+	}
+	chan->cur_addr.value += n;
+	chan->cur_count.value -= n;
+	done += n;
+
+	if (chan->cur_count.value == 0xffff) {
+	    if (DMA_AUTOINIT(chan->mode)) {
+		q_printf("DMA: controller %i, channel %i reinitialized\n",
+			 di, ci);
+		chan->cur_addr.value = chan->base_addr.value;
+		chan->cur_count.value = chan->base_count.value;
+	    } else {
+		q_printf("DMA: controller %i, channel %i TC\n", di, ci);
+		dma[di].status |= 1 << ci;
+		dma[di].request &= ~(1 << ci);
+		dma[di].mask |= 1 << ci;
+		break;
+	    }
+	}
+    }
+    DMA_UNLOCK();
+    return done << di;
+}
+
 
 /* lets ride on the cpp ass */
 #define d(x) (x-1)
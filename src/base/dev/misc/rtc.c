@@ -18,11 +18,14 @@
 #include "timers.h"
 #include "int.h"
 #include "iodev.h"
+#include "deadline.h"
 
 long   sys_base_ticks = 0;
 long   usr_delta_ticks = 0;
 unsigned long   last_ticks = 0;
 static unsigned long long q_ticks_m = 0;
+static int rtc_dl = -1;
+static hitimer_t rtc_dl_time;
 
 
 static int rtc_get_rate(Bit8u div)
@@ -34,6 +37,25 @@ static int rtc_get_rate(Bit8u div)
   return (65536 >> div);
 }
 
+/* wake up when the next periodic interrupt is due, rather than
+ * wait for the main loop to poll us */
+static void rtc_set_deadline(hitimer_t when)
+{
+  if (rtc_dl == -1 || when == rtc_dl_time)
+    return;
+  rtc_dl_time = when;
+  if (when)
+    deadline_set(rtc_dl, when);
+  else
+    deadline_cancel(rtc_dl);
+}
+
+static void rtc_expired(void *arg)
+{
+  rtc_dl_time = 0;
+  rtc_run();
+}
+
 void rtc_run(void)
 {
   static hitimer_t last_time = -1;
@@ -42,6 +64,7 @@ void rtc_run(void)
   if (last_time == -1 || last_time > cur_time ||
       !(GET_CMOS(CMOS_STATUSB) & 0x40)) {
     last_time = cur_time;
+    rtc_set_deadline(0);
     return;
   }
   rate = rtc_get_rate(GET_CMOS(CMOS_STATUSA) & 0x0f);
@@ -65,6 +88,11 @@ void rtc_run(void)
     if (!(old_c & 0x40))
       q_ticks_m -= 1000000;
   }
+  /* with IRQ8 still pending, reading C brings us back here */
+  if (rate && q_ticks_m < 1000000 && !(GET_CMOS(CMOS_STATUSC) & 0x80))
+    rtc_set_deadline(cur_time + (1000000 - q_ticks_m + rate - 1) / rate);
+  else
+    rtc_set_deadline(0);
 }
 
 Bit8u rtc_read(Bit8u reg)
@@ -270,6 +298,9 @@ void rtc_init (void)
   SET_CMOS(CMOS_HOURALRM, 0);
   SET_CMOS(CMOS_MINALRM,  0);
   SET_CMOS(CMOS_SECALRM,  0);
+
+  if (rtc_dl == -1)
+    rtc_dl = deadline_register(rtc_expired, NULL, "rtc");
 }
 
 
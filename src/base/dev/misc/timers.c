@@ -12,14 +12,11 @@
  * A lot of animation and video game software are dependant on this module
  * for high frequency timer interrupts (IRQ0).
  *
- * This code will actually generate 18.2 DOS interrupts/second (the code
- * here itself will be triggered about 100 times per second). It will even
- * happily attempt to generate faster clocks, right up to the point where
- * it chokes.  Since the absolute best case timing we can get out of Linux
- * is 100Hz, figure that anything approaching or exceeding that isn't going
- * to work well.  (The code will attempt to generate up to 10Khz interrupts
- * per second at the moment.  Too bad that would probably overflow all
- * internal queues really fast. :)
+ * Each IRQ0 is scheduled in pic from the programmed divisor, one period
+ * after the previous one, and pic arms a host timer deadline for it, so
+ * rates of several kHz are delivered close to their due time rather than
+ * in bursts at the 100Hz housekeeping tick. The delivery latency and the
+ * jitter of the interval are kept in histograms, see pit_print_stats().
  *
  * Speaker emulation, now including port 61h, is also in here. [rz]
  *
@@ -30,6 +27,8 @@
 
 #include <sys/time.h>
 #include <sys/ioctl.h>
+#include <stdarg.h>
+#include <limits.h>
 
 #include "emu.h"
 #include "port.h"
@@ -38,6 +37,8 @@
 #include "int.h"
 #include "pic.h"
 #include "dpmi.h"
+#include "utilities.h"
+#include "latstat.h"
 
 #undef  DEBUG_PIT
 #undef  ONE_MINUTE_TEST
@@ -49,6 +50,10 @@ static u_long ticks_accum;        /* For timer_tick function, 100usec ticks */
 
 static Bit8u port61 = 0x0c;
 
+static struct lat_stat irq0_lat;  /* due time to delivery, us */
+static struct lat_stat irq0_jit;  /* deviation from the period, us */
+static hitimer_t irq0_last, irq0_stat_start;
+
 int is_cli;
 
 /*
@@ -95,6 +100,7 @@ void initialize_timers(void)
   ticks_accum   = 0;
   timer_div     = (pit[0].cntr * 10000) / PIT_TICK_RATE;
 
+  pit_reset_stats();
   timer_tick();  /* a starting tick! */
 
   port61 = 0x0c;
@@ -416,6 +422,12 @@ void pit_outp(ioport_t port, Bit8u val)
     pit[port].time.td = GETtickTIME(0);
 
     if (port == 0) {
+      /* after a mode set the new count starts right away, otherwise
+       * it is loaded at the end of the current period */
+      if (pit[0].restart && (pit[0].mode & 2)) {
+	pic_resched(PIC_IRQ0, pit[0].time.td, pit[0].cntr);
+	irq0_last = 0;
+      }
       ticks_accum   = 0;
       timer_div     = (pit[0].cntr * 10000) / PIT_TICK_RATE;
       if (timer_div == 0)
@@ -430,6 +442,7 @@ void pit_outp(ioport_t port, Bit8u val)
       do_sound(pit[2].write_latch & 0xffff);
     }
 #endif
+    pit[port].restart = 0;
   }
 }
 
@@ -481,6 +494,8 @@ void pit_control_outp(ioport_t port, Bit8u val)
 	pit[latch].read_state  = (val >> 4) & 0x03;
 	pit[latch].write_state = (val >> 4) & 0x03;
 	pit[latch].mode        = (val >> 1) & 0x07;
+	/* the counter restarts when the count is written */
+	pit[latch].restart     = 1;
         if ((val & 4)==0) {      /* modes 0,1,4,5 */
           /* set the time base for the counter - safety code for programs
            * which use a non-periodical mode without reloading the counter
@@ -530,12 +545,71 @@ void pit_control_outp(ioport_t port, Bit8u val)
  *
  * DANG_END_FUNCTION
  */
+static unsigned ticks_to_us(hitimer_t t)
+{
+  if (t >= UStoTICK(UINT_MAX))
+    return UINT_MAX;
+  return TICKtoUS(t);
+}
+
+static void irq0_account(hitimer_t now)
+{
+  hitimer_t due = pic_itime[PIC_IRQ0];
+
+  if (due != NEVER && now >= due)
+    lat_add(&irq0_lat, ticks_to_us(now - due));
+  if (irq0_last && now >= irq0_last) {
+    hitimer_t iv = now - irq0_last;
+
+    lat_add(&irq0_jit, ticks_to_us(iv > pit[0].cntr ? iv - pit[0].cntr :
+	pit[0].cntr - iv));
+  }
+  irq0_last = now;
+}
+
 static int timer_int_engine(int ilevel)
 {
+ irq0_account(GETtickTIME(0));
  pic_sched(PIC_IRQ0,pit[0].cntr);
  return 1;
 }
 
+void pit_reset_stats(void)
+{
+  lat_reset(&irq0_lat);
+  lat_reset(&irq0_jit);
+  irq0_last = 0;
+  irq0_stat_start = GETtickTIME(0);
+}
+
+void pit_print_stats(cmdprintf_func *printf)
+{
+  hitimer_t t = GETtickTIME(0) - irq0_stat_start;
+
+  (*printf)("IRQ0: period %i ticks (%.1f Hz), delivered %llu (%.1f Hz)\n",
+      pit[0].cntr, PIT_TICK_RATE / (double)pit[0].cntr, irq0_lat.count,
+      t ? irq0_lat.count * (double)PIT_TICK_RATE / t : 0.0);
+  (*printf)("  latency, us: mean %u, p99 %u, max %u\n",
+      lat_mean(&irq0_lat), lat_percentile(&irq0_lat, 99), irq0_lat.max);
+  (*printf)("  jitter,  us: mean %u, p99 %u, max %u\n",
+      lat_mean(&irq0_jit), lat_percentile(&irq0_jit, 99), irq0_jit.max);
+}
+
+static void pit_stats_printf(const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  vlog_printf(debug_level('g'), fmt, args);
+  va_end(args);
+}
+
+void pit_done(void)
+{
+  if (irq0_lat.count)
+    pit_print_stats(pit_stats_printf);
+}
+
 /* reads/writes to the speaker control port (0x61)
  * Port 0x61 is really more complex than a speaker enable bit... look here:
  * [output]:
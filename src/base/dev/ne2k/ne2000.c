@@ -173,6 +173,7 @@ Bit16u ne2000_io_read16(ioport_t port);
 void ne2000_io_write16(ioport_t port, Bit16u value);
 Bit8u ne2000_io_read8(ioport_t port);
 void ne2000_io_write8(ioport_t port, Bit8u value);
+static const emu_iodev_rep_t ne2000_rep;
 static void ne2000_irq_activate(int);
 
 static void ne2000_receive_req_async(void *arg);
@@ -230,6 +231,7 @@ void ne2000_init(void)
         ne2000_done();
         return;
     }
+    port_register_rep_handler(NE2000_IOBASE, &ne2000_rep);
 
     /* init control defaults */
     s->irq = pic_irq_list[NE2000_IRQ];
@@ -904,6 +906,132 @@ void ne2000_io_write16(ioport_t port, Bit16u value)
         ne2000_write(s, addr, (uint8_t)value, 1); /* default to 8 bit */
 }
 
+/* --------------------------------- */
+/* REP INS/OUTS on the data port: the packet buffer is copied in as
+ * few pieces as the remote DMA state allows */
+
+/* number of len-sized accesses at rsar that can be done as one copy:
+ * no ring wrap, no end of the remote DMA and no invalid memory
+ * on the way */
+static uint32_t ne2000_dma_chunk(NE2000State *s, uint32_t count, int len)
+{
+    uint32_t addr = (len == 2 ? s->rsar & ~1 : s->rsar);
+    uint32_t n, lim;
+
+    if (s->rcnt <= len)
+        return 0;
+    /* leave the access that completes the DMA to the slow path */
+    n = (s->rcnt - 1) / len;
+    if (s->rsar < s->stop && (s->stop - s->rsar) % len == 0 &&
+            (s->stop - s->rsar) / len < n)
+        n = (s->stop - s->rsar) / len;
+    if (addr < 32)
+        lim = 32;
+    else if (addr >= NE2000_PMEM_START && addr < NE2000_MEM_SIZE)
+        lim = NE2000_MEM_SIZE;
+    else
+        return 0;
+    if ((lim - addr) / len < n)
+        n = (lim - addr) / len;
+    return (count < n ? count : n);
+}
+
+static uint32_t ne2000_data_chunk(ioport_t port, uint32_t count, int len)
+{
+    NE2000State *s = &ne2000state;
+
+    if (port - NE2000_IOBASE != 0x10 || !(s->dcfg & 0x01) != (len == 1))
+        return 0;
+    return ne2000_dma_chunk(s, count, len);
+}
+
+static void ne2000_rep_inb(ioport_t port, Bit8u *dest, Bit32u count)
+{
+    NE2000State *s = &ne2000state;
+
+    N_printf("NE2000: ne2000_rep_inb() %u\n", count);
+    while (count) {
+        uint32_t n = ne2000_data_chunk(port, count, 1);
+
+        if (!n) {
+            *dest++ = ne2000_io_read8(port);
+            count--;
+            continue;
+        }
+        memcpy(dest, s->mem + s->rsar, n);
+        ne2000_dma_update(s, n);
+        dest += n;
+        count -= n;
+    }
+}
+
+static void ne2000_rep_outb(ioport_t port, const Bit8u *src, Bit32u count)
+{
+    NE2000State *s = &ne2000state;
+
+    N_printf("NE2000: ne2000_rep_outb() %u\n", count);
+    while (count) {
+        uint32_t n = ne2000_data_chunk(port, count, 1);
+
+        if (!n) {
+            ne2000_io_write8(port, *src++);
+            count--;
+            continue;
+        }
+        memcpy(s->mem + s->rsar, src, n);
+        ne2000_dma_update(s, n);
+        src += n;
+        count -= n;
+    }
+}
+
+static void ne2000_rep_inw(ioport_t port, Bit16u *dest, Bit32u count)
+{
+    NE2000State *s = &ne2000state;
+
+    N_printf("NE2000: ne2000_rep_inw() %u\n", count);
+    while (count) {
+        uint32_t n = ne2000_data_chunk(port, count, 2);
+
+        if (!n) {
+            *dest++ = ne2000_io_read16(port);
+            count--;
+            continue;
+        }
+        memcpy(dest, s->mem + (s->rsar & ~1), n * 2);
+        ne2000_dma_update(s, n * 2);
+        dest += n;
+        count -= n;
+    }
+}
+
+static void ne2000_rep_outw(ioport_t port, const Bit16u *src, Bit32u count)
+{
+    NE2000State *s = &ne2000state;
+
+    N_printf("NE2000: ne2000_rep_outw() %u\n", count);
+    while (count) {
+        uint32_t n = ne2000_data_chunk(port, count, 2);
+
+        if (!n) {
+            ne2000_io_write16(port, *src++);
+            count--;
+            continue;
+        }
+        memcpy(s->mem + (s->rsar & ~1), src, n * 2);
+        ne2000_dma_update(s, n * 2);
+        src += n;
+        count -= n;
+    }
+}
+
+static const emu_iodev_rep_t ne2000_rep = {
+    .rep_inb = ne2000_rep_inb,
+    .rep_outb = ne2000_rep_outb,
+    .rep_inw = ne2000_rep_inw,
+    .rep_outw = ne2000_rep_outw,
+};
+
 /* --------------------------------- */
 
 /* handle io reads from ne2000 */
@@ -122,6 +122,9 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
 #include <inttypes.h>
 
 #include "port.h"
@@ -139,10 +142,13 @@
 #include "int.h"
 #include "ipx.h"
 #include "pic.h"
+#include "deadline.h"
+#include "latstat.h"
 
 #undef us
 #define us unsigned
 static void pic_activate(void);
+static void pic_update_deadline(void);
 
 #define TIMER0_FLOOD_THRESHOLD 50000
 
@@ -191,6 +197,22 @@ static   hitimer_t pic_ltime[33] =     /* timeof last pic request honored */
                  NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER,
                  NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER,
                  NEVER};
+static   int pic_dl = -1;          /* host timer deadline for pic_itime */
+static   hitimer_t pic_dl_time = NEVER;
+
+/* delivery statistics of the real IRQ levels, usecs of DOS time.
+ * Always on: it's a cached clock read and a few adds per interrupt. */
+#define PIC_STAT_LEVELS 16
+struct pic_stat {
+  hitimer_t req_time;              /* 0 if not waiting for an ack */
+  hitimer_t ack_time;              /* 0 if not waiting for an EOI */
+  unsigned long requests;
+  unsigned long deferred;          /* came while in IRR/ISR, kept in pirr */
+  unsigned long lost;              /* came while already in pirr */
+  struct lat_stat req_ack;
+  struct lat_stat ack_eoi;
+};
+static struct pic_stat pic_stats[PIC_STAT_LEVELS];
          hitimer_t pic_itime[33] =     /* time to trigger next interrupt */
                 {NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER,
                  NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER, NEVER,
@@ -354,6 +376,120 @@ static void set_pic1_base(unsigned char int_num)
 }
 
 
+static unsigned pic_stat_delta(hitimer_t from, hitimer_t to)
+{
+  if (to <= from)
+    return 0;
+  return (to - from > UINT_MAX ? UINT_MAX : to - from);
+}
+
+static void pic_stat_request(int ilevel, int ret)
+{
+  struct pic_stat *ps;
+
+  if (ilevel >= PIC_STAT_LEVELS)
+    return;
+  ps = &pic_stats[ilevel];
+  ps->requests++;
+  switch (ret) {
+  case PIC_REQ_OK:
+    if (!ps->req_time)
+      ps->req_time = GETusTIME(0);
+    break;
+  case PIC_REQ_PEND:
+    ps->deferred++;
+    break;
+  case PIC_REQ_LOST:
+    ps->lost++;
+    break;
+  }
+}
+
+/* deferred requests start waiting when they get from pirr to irr */
+static void pic_stat_irr(unsigned long newirr)
+{
+  hitimer_t now = GETusTIME(0);
+  int ilevel;
+
+  newirr &= (1 << PIC_STAT_LEVELS) - 1;
+  while (newirr) {
+    ilevel = find_bit(newirr);
+    newirr &= ~(1UL << ilevel);
+    if (!pic_stats[ilevel].req_time)
+      pic_stats[ilevel].req_time = now;
+  }
+}
+
+static void pic_stat_ack(int ilevel)
+{
+  struct pic_stat *ps;
+  hitimer_t now;
+
+  if (ilevel >= PIC_STAT_LEVELS)
+    return;
+  ps = &pic_stats[ilevel];
+  now = GETusTIME(0);
+  if (ps->req_time)
+    lat_add(&ps->req_ack, pic_stat_delta(ps->req_time, now));
+  ps->req_time = 0;
+  ps->ack_time = now;
+}
+
+static void pic_stat_eoi(int ilevel)
+{
+  struct pic_stat *ps;
+
+  if (ilevel >= PIC_STAT_LEVELS)
+    return;
+  ps = &pic_stats[ilevel];
+  if (!ps->ack_time)
+    return;
+  lat_add(&ps->ack_eoi, pic_stat_delta(ps->ack_time, GETusTIME(0)));
+  ps->ack_time = 0;
+}
+
+void pic_reset_stats(void)
+{
+  memset(pic_stats, 0, sizeof(pic_stats));
+}
+
+void pic_print_stats(void (*printf)(const char *, ...))
+{
+  int irq;
+
+  (*printf)("IRQ  requests  deferred      lost   req->ack mean/p99/max us"
+      "   ack->EOI mean/p99/max us\n");
+  for (irq = 0; irq < 16; irq++) {
+    struct pic_stat *ps;
+
+    if (irq == 2)
+      continue;
+    ps = &pic_stats[pic_irq_list[irq]];
+    if (!ps->requests)
+      continue;
+    (*printf)("%3i %9lu %9lu %9lu %9u/%u/%u %14u/%u/%u\n", irq,
+	ps->requests, ps->deferred, ps->lost,
+	lat_mean(&ps->req_ack), lat_percentile(&ps->req_ack, 99),
+	ps->req_ack.max,
+	lat_mean(&ps->ack_eoi), lat_percentile(&ps->ack_eoi, 99),
+	ps->ack_eoi.max);
+  }
+}
+
+static void pic_stats_printf(const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  vlog_printf(debug_level('r'), fmt, args);
+  va_end(args);
+}
+
+void pic_done(void)
+{
+  pic_print_stats(pic_stats_printf);
+}
+
 /* DANG_BEGIN_FUNCTION write_pic0,write_pic1
  *
  * write_pic_0() and write_pic1() implement dos writes to the pic ports.
@@ -407,6 +543,7 @@ if(!port){                          /* icw1, ocw2, ocw3 */
     /* irqs on pic1 require an outb20 to each pic. we settle for any 2 */
      if(!clear_bit(ilevel,&pic1_isr)) {
        clear_bit(ilevel,&pic_isr);  /* the famous outb20 */
+       pic_stat_eoi(ilevel);
        pic_print(1,"EOI resetting bit ",ilevel, " on pic0");
 #if 1
 	/* XXX hack: to avoid timer interrupt re-entrancy,
@@ -477,6 +614,7 @@ if(!port){                            /* icw1, ocw2, ocw3 */
     /* irqs on pic1 require an outb20 to each pic. we settle for any 2 */
      if(!clear_bit(ilevel,&pic1_isr)) {
        clear_bit(ilevel,&pic_isr);  /* the famous outb20 */
+       pic_stat_eoi(ilevel);
        pic_print(1,"EOI resetting bit ",ilevel, " on pic0");
        }
      else
@@ -644,6 +782,7 @@ static void do_irq(int ilevel)
     int intr;
 
     set_bit(ilevel, &pic_isr);     /* set in-service bit */
+    pic_stat_ack(ilevel);
     set_bit(ilevel, &pic1_isr);    /* pic1 too */
     pic1_isr &= pic_isr & pic1_mask;         /* isolate pic1 irqs */
 
@@ -707,6 +846,7 @@ static char buf[81];
     pic_ltime[inum] = pic_itime[inum];
     ret=PIC_REQ_OK;
   }
+  pic_stat_request(inum, ret);
   if (debug_level('r') >2) {
     /* avoid going through sprintf for non-debugging */
     sprintf(buf,", k%d",(int)pic_dpmi_count);
@@ -746,6 +886,8 @@ void pic_untrigger(int inum)
      */
     pic_pirr &= ~(1<<inum);
     pic_irr &= ~(1<<inum);
+    if (inum < PIC_STAT_LEVELS)
+      pic_stats[inum].req_time = 0;
     pic_print(2,"Requested irq lvl ", inum, " untriggered");
 }
 
@@ -835,6 +977,8 @@ static void pic_activate(void)
   pic_newirr = pic_pirr & ~(pic_irr | pic_isr);
   pic_irr |= pic_newirr;
   pic_pirr &= ~pic_newirr;
+  if (pic_newirr)
+    pic_stat_irr(pic_newirr);
 
 /*if(pic_irr&~pic_imr) return;*/
    earliest = pic_sys_time;
@@ -855,6 +999,42 @@ static void pic_activate(void)
    pic_itime[32] = earliest;
    if (count)
       pic_dos_time = earliest;
+   pic_update_deadline();
+}
+
+/* ask for a host timer wakeup at the earliest scheduled interrupt, so
+ * that it doesn't have to wait for the next periodic tick */
+static void pic_update_deadline(void)
+{
+  hitimer_t earliest = NEVER;
+  int timer;
+
+  if (pic_dl == -1)
+    return;
+  for (timer = 0; timer < 32; ++timer) {
+    if (pic_itime[timer] == NEVER || pic_itime[timer] == pic_ltime[timer] ||
+        pic_itime[timer] < pic_sys_time)
+      continue;
+    if (pic_itime[timer] < earliest)
+      earliest = pic_itime[timer];
+  }
+  if (earliest == pic_dl_time)
+    return;
+  pic_dl_time = earliest;
+  if (earliest == NEVER)
+    deadline_cancel(pic_dl);
+  else
+    deadline_set(pic_dl, TICKtoUS(earliest) + 1);
+}
+
+static void pic_expired(void *arg)
+{
+  hitimer_u tp;
+
+  /* the deadline is gone, whatever pic_watch finds out */
+  pic_dl_time = NEVER;
+  tp.td = GETtickTIME(0);
+  pic_watch(&tp);
 }
 
 /* DANG_BEGIN_FUNCTION pic_sched
@@ -907,6 +1087,23 @@ void pic_sched(int ilevel, int interval)
     pic_print(2,"Scheduling lvl= ",ilevel,mesg);
     pic_print2(2,"pic_itime set to ",pic_itime[ilevel],"");
   }
+  pic_update_deadline();
+}
+
+/* DANG_BEGIN_FUNCTION pic_resched
+ * pic_resched restarts the periodic interrupt of a level at 'start',
+ * with the first one due an interval later. Used when the guest
+ * reprograms the PIT. If the previous interrupt is still waiting in
+ * IRR, its handler's pic_sched() will count from 'start'.
+ * DANG_END_FUNCTION
+ */
+void pic_resched(int ilevel, hitimer_t start, int interval)
+{
+  if (pic_irr & (1 << ilevel))
+    pic_itime[ilevel] = pic_ltime[ilevel] = start;
+  else
+    pic_itime[ilevel] = start + interval;
+  pic_update_deadline();
 }
 
 int CAN_SLEEP(void)
@@ -942,9 +1139,12 @@ void pic_init(void)
   io_device.read_portb   = read_pic1;
   io_device.write_portb  = write_pic1;
   port_register_handler(io_device, 0);
+
+  pic_dl = deadline_register(pic_expired, NULL, "pic");
 }
 
 void pic_reset(void)
 {
   pic_set_mask;
+  pic_reset_stats();
 }
@@ -32,12 +32,12 @@
 #include "timers.h"
 #include "utilities.h"
 #include "sound/sound.h"
+#include "sound/synth.h"
 #include "sound.h"
 #include "adlib.h"
 #include "dbadlib.h"
 #include <limits.h>
 #include <pthread.h>
-#include <semaphore.h>
 
 #define ADLIB_BASE 0x388
 #define OPL3_INTERNAL_FREQ    14400000	// The OPL3 operates at 14.4MHz
@@ -66,9 +66,7 @@ static const int opl3_rate = 44100;
 
 static pthread_mutex_t synth_mtx = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t run_mtx = PTHREAD_MUTEX_INITIALIZER;
-static pthread_t syn_thr;
-static sem_t syn_sem;
-static void *synth_thread(void *arg);
+static void adlib_synth_run(void *arg, long long now);
 
 Bit8u adlib_io_read_base(ioport_t port)
 {
@@ -149,12 +147,8 @@ void opl3_init(void)
 
     dbadlib_init(opl3_timers, opl3_rate);
 
-    sem_init(&syn_sem, 0, 0);
-    pthread_create(&syn_thr, NULL, synth_thread, NULL);
-#if defined(HAVE_PTHREAD_SETNAME_NP) && defined(__GLIBC__)
-    pthread_setname_np(syn_thr, "dosemu: adlib");
-#endif
     adlib_strm = pcm_allocate_stream(ADLIB_CHANNELS, "Adlib", (void*)MC_MIDI);
+    synth_register(adlib_synth_run, NULL, "adlib");
 }
 
 void adlib_reset(void)
@@ -164,9 +158,7 @@ void adlib_reset(void)
 
 void adlib_done(void)
 {
-    pthread_cancel(syn_thr);
-    pthread_join(syn_thr, NULL);
-    sem_destroy(&syn_sem);
+    synth_unregister(adlib_synth_run, NULL);
 }
 
 static void adlib_process_samples(int nframes)
@@ -181,14 +173,13 @@ static void adlib_process_samples(int nframes)
 
 /* we know that timer updates do not affect synth, so disable that code */
 #define UPDATE_TIMERS 0
-static void adlib_run(void)
+static void adlib_run(long long now)
 {
 #if UPDATE_TIMERS
     int i;
 #endif
     int nframes;
     double period, adlib_time_cur;
-    long long now;
     int time_adj;
 
     adlib_time_cur = pcm_time_lock(adlib_strm);
@@ -201,7 +192,6 @@ static void adlib_run(void)
 	return;
     }
     if (adlib_running) do {
-	now = GETusTIME(0);
 	time_adj = 0;
 #if UPDATE_TIMERS
 	/* find the closest timer */
@@ -237,24 +227,13 @@ static void adlib_run(void)
     pcm_time_unlock(adlib_strm);
 }
 
-static void *synth_thread(void *arg)
+static void adlib_synth_run(void *arg, long long now)
 {
     int a_run;
-    while (1) {
-	sem_wait(&syn_sem);
-	pthread_mutex_lock(&run_mtx);
-	a_run = adlib_running;
-	pthread_mutex_unlock(&run_mtx);
-	if (!a_run)
-	    continue;
-	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-	adlib_run();
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    }
-    return NULL;
-}
-
-void adlib_timer(void)
-{
-    sem_post(&syn_sem);
+    pthread_mutex_lock(&run_mtx);
+    a_run = adlib_running;
+    pthread_mutex_unlock(&run_mtx);
+    if (!a_run)
+	return;
+    adlib_run(now);
 }
@@ -30,7 +30,6 @@
 void opl3_init(void);
 void adlib_done(void);
 void adlib_reset(void);
-void adlib_timer(void);
 Bit8u adlib_io_read_base(ioport_t port);
 void adlib_io_write_base(ioport_t port, Bit8u value);
 
@@ -35,11 +35,13 @@
 #include "sig.h"
 #include "sound/sound.h"
 #include "sound/midi.h"
+#include "sound/synth.h"
 #include "sound.h"
 #include "adlib.h"
 #include "dma.h"
 #include "sb16.h"
 #include "dspio.h"
+#include "deadline.h"
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -72,6 +74,7 @@ struct dspio_state {
     int input_running:1, output_running:1, dac_running:1, speaker:1;
     int pcm_input_running:1, lin_input_running:1, mic_input_running:1;
     int i_handle, i_started;
+    int sound_dl;
 #define DSP_FIFO_SIZE 64
     struct rng_s fifo_in;
     struct rng_s fifo_out;
@@ -121,7 +124,10 @@ void dspio_write_midi(void *dspio, Bit8u value)
     run_sb();
 }
 
-static void run_sound(void)
+/* the players keep their own buffers, so an idle stream can wait */
+#define SOUND_IDLE_PERIOD 200000
+
+static void run_sound(void *arg)
 {
     if (!config.sound)
 	return;
@@ -129,6 +135,11 @@ static void run_sound(void)
     pcm_timer();
 }
 
+static int sound_idle(void *arg)
+{
+    return !pcm_playing();
+}
+
 static int dspio_out_fifo_len(struct dspio_dma *dma)
 {
     return dma->dsp_fifo_enabled ? DSP_OUT_FIFO_TRIGGER : 2;
@@ -428,7 +439,9 @@ void *dspio_init(void)
 
     midi_init();
 
-    sigalrm_register_handler(run_sound);
+    state->sound_dl = deadline_register(run_sound, NULL, "sound");
+    deadline_set_periodic(state->sound_dl, config.update / TIMER_DIVISOR,
+	    SOUND_IDLE_PERIOD, sound_idle);
     return state;
 }
 
@@ -438,6 +451,7 @@ void dspio_reset(void *dspio)
 
 void dspio_done(void *dspio)
 {
+    deadline_cancel(DSPIO->sound_dl);
     midi_done();
     /* shutdown midi before pcm as midi may use pcm */
     pcm_done();
@@ -596,9 +610,19 @@ static int do_run_dma(struct dspio_state *state)
     return 1;
 }
 
-static int dspio_run_dma(struct dspio_state *state)
+static void dspio_dma_nack(struct dspio_state *state, hitimer_t now)
 {
 #define DMA_TIMEOUT_US 100000
+    sb_dma_nack();
+    if (now - state->dma.time_cur > DMA_TIMEOUT_US) {
+	S_printf("SB: Warning: DMA busy for too long, releasing\n");
+//		error("SB: DMA timeout\n");
+	sb_handle_dma_timeout();
+    }
+}
+
+static int dspio_run_dma(struct dspio_state *state)
+{
     int ret;
     struct dspio_dma *dma = &state->dma;
     hitimer_t now = GETusTIME(0);
@@ -607,16 +631,48 @@ static int dspio_run_dma(struct dspio_state *state)
 	sb_handle_dma();
 	dma->time_cur = now;
     } else {
-	sb_dma_nack();
-	if (now - dma->time_cur > DMA_TIMEOUT_US) {
-	    S_printf("SB: Warning: DMA busy for too long, releasing\n");
-//		error("SB: DMA timeout\n");
-	    sb_handle_dma_timeout();
-	}
+	dspio_dma_nack(state, now);
     }
     return ret;
 }
 
+/* Playback: move up to max samples in one go, but not past the end of
+ * the SB block, so the IRQ and auto-init still come from
+ * sb_handle_dma(). Returns the number of samples moved. */
+static int dspio_run_dma_burst(struct dspio_state *state, int max)
+{
+    Bit8u buf[DSP_FIFO_SIZE * 2];
+    struct dspio_dma *dma = &state->dma;
+    int unit = dma->is16bit ? 2 : 1;
+    int i, n, left;
+    hitimer_t now;
+
+    if (dma->input || dma->silence || dma->broken_hdma || max <= 1)
+	return (max > 0 ? dspio_run_dma(state) : 0);
+    left = sb_dma_block_left();
+    if (max > left)
+	max = left;
+    if (max > DSP_FIFO_SIZE)
+	max = DSP_FIFO_SIZE;
+    now = GETusTIME(0);
+    n = dma_burst_DRQ(dma->num, buf, max * unit) / unit;
+    if (!n) {
+	S_printf("SB: DMA %i doesn't DACK!\n", dma->num);
+	dspio_dma_nack(state, now);
+	return 0;
+    }
+    if (dma->adpcm && dma->adpcm_need_ref) {
+	dma->adpcm_ref = buf[0];
+	dma->adpcm_step = 0;
+	dma->adpcm_need_ref = 0;
+    }
+    for (i = 0; i < n; i++)
+	dspio_put_dma_data(state, buf + i * unit, dma->is16bit);
+    sb_handle_dma_burst(n);
+    dma->time_cur = now;
+    return n;
+}
+
 static void get_dma_params(struct dspio_dma *dma)
 {
     int dma_16bit = sb_dma_16bit();
@@ -645,9 +701,11 @@ static int dspio_fill_output(struct dspio_state *state)
 {
     int dma_cnt = 0;
     while (state->dma.running && !dspio_output_fifo_filled(state)) {
-	if (!dspio_run_dma(state))
+	int n = dspio_run_dma_burst(state, dspio_out_fifo_len(&state->dma) -
+		rng_count(&state->fifo_out));
+	if (!n)
 	    break;
-	dma_cnt++;
+	dma_cnt += n;
     }
 #if 0
     if (!state->output_running && !sb_output_fifo_empty())
@@ -754,9 +812,12 @@ static void dspio_process_dma(struct dspio_state *state)
 	memset(n, 0, sizeof(n));
 	for (j = 0; j < state->dma.stereo + 1; j++) {
 	    if (state->dma.running && !dspio_output_fifo_filled(state)) {
-		if (!dspio_run_dma(state))
+		int cnt = dspio_run_dma_burst(state,
+			dspio_out_fifo_len(&state->dma) -
+			rng_count(&state->fifo_out));
+		if (!cnt)
 		    break;
-		dma_cnt++;
+		dma_cnt += cnt;
 	    }
 	    n[j] = dspio_get_output_sample(state, buf, i, j);
 	    if (!n[j]) {
@@ -888,7 +949,7 @@ static void dspio_process_midi(struct dspio_state *state)
 
 void dspio_run_synth(void)
 {
-    adlib_timer();
+    synth_timer();
     midi_timer();
 }
 
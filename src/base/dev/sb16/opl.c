@@ -29,6 +29,9 @@
 #include <stdlib.h> // rand()
 #include <string.h>
 #include <stdbool.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "types.h"
 #include "opl_priv.h"
 #include "opl.h"
@@ -205,7 +208,9 @@ static void operator_output(op_type* op_pt, Bit32s modulator, Bit32s trem) {
 		// step_amp: 0.0 to 1.0
 		// vol  : 1/2^14 to 1/2^29 (/0x4000; /1../0x8000)
 
-		op_pt->cval = (Bit32s)(op_pt->step_amp*op_pt->vol*op_pt->cur_wform[i&op_pt->cur_wmask]*trem/16.0);
+		// trem/16.0 is exact, so this rounds the same as (...)*trem/16.0
+		// but keeps a multiply and a divide off the feedback path
+		op_pt->cval = (Bit32s)(op_pt->step_amp*op_pt->vol*op_pt->cur_wform[i&op_pt->cur_wmask]*(trem/16.0));
 	}
 }
 
@@ -319,6 +324,103 @@ optype_fptr opfuncs[6] = {
 	operator_off
 };
 
+// opfuncs[] with direct calls, so that the envelope functions get inlined
+static inline void operator_envelope(op_type* op_pt) {
+	switch (op_pt->op_state) {
+	case OF_TYPE_ATT: operator_attack(op_pt); break;
+	case OF_TYPE_DEC: operator_decay(op_pt); break;
+	case OF_TYPE_SUS: operator_sustain(op_pt); break;
+	case OF_TYPE_REL:
+	case OF_TYPE_SUS_NOKEEP: operator_release(op_pt); break;
+	}
+}
+
+// The double math below only gives the same bits as the scalar code if
+// the compiler does scalar math in SSE registers as well (not x87).
+#if defined(__SSE2__) && defined(__SSE2_MATH__)
+#define OPL_SSE2 1
+#endif
+
+// Run one operator over a block of samples, out[] receives its output.
+// mod[] is the output of the modulating operator (NULL: none), vib NULL
+// means no vibrato; fb selects self-feedback as for the first operator
+// of a channel. Operators only see each other through their outputs, so
+// running a channel operator by operator gives the same result as the
+// sample by sample loop, but the envelope steps stay in a tight scalar
+// loop and the output scaling is done 2 samples at a time.
+static void operator_block(op_type* op_pt, const Bit32s* mod, const Bit32s* vib,
+		const Bit32s* trem, bool fb, Bit32s* out, Bits n) {
+	Bit32s wf[BLOCKBUF_SIZE];
+	fltype sa[BLOCKBUF_SIZE];
+	Bits i, m;
+
+	if (!vib) vib = vibval_const;
+	if (fb && op_pt->mfbi) {
+		// feedback needs the previous output, no way around the serial
+		// loop, but keep the outputs in registers
+		Bit32s cval = op_pt->cval, lastcval = op_pt->lastcval;
+		Bit32s mfbi = op_pt->mfbi;
+		for (i=0;i<n;i++) {
+			operator_advance(op_pt,vib[i]);
+			operator_envelope(op_pt);
+			if (op_pt->op_state != OF_TYPE_OFF) {
+				Bit32u idx = (Bit32u)((op_pt->wfpos+(lastcval+cval)*mfbi/2)/FIXEDPT);
+				lastcval = cval;
+				cval = (Bit32s)(op_pt->step_amp*op_pt->vol*op_pt->cur_wform[idx&op_pt->cur_wmask]*(trem[i]/16.0));
+			}
+			out[i] = cval;
+		}
+		op_pt->cval = cval;
+		op_pt->lastcval = lastcval;
+		return;
+	}
+
+	if (op_pt->op_state == OF_TYPE_SUS) {
+		// the envelope holds until the next register write, so only the
+		// phase moves; the envelope clock is caught up in one go
+		fltype amp = op_pt->step_amp*op_pt->vol;
+		for (m=0;m<n;m++) {
+			op_pt->wfpos = op_pt->tcount;
+			op_pt->tcount += op_pt->tinc;
+			op_pt->tcount += (int64_t)(op_pt->tinc)*vib[m]/FIXEDPT;
+			Bit32u idx = (Bit32u)((op_pt->wfpos+(mod ? mod[m]*FIXEDPT : 0))/FIXEDPT);
+			wf[m] = op_pt->cur_wform[idx&op_pt->cur_wmask];
+			sa[m] = amp;
+		}
+		Bit32u gen = op_pt->generator_pos + n*generator_add;
+		op_pt->cur_env_step += gen/FIXEDPT;
+		op_pt->generator_pos = gen%FIXEDPT;
+	} else for (m=0;m<n;m++) {
+		operator_advance(op_pt,vib[m]);
+		operator_envelope(op_pt);
+		if (op_pt->op_state == OF_TYPE_OFF) break;
+		Bit32u idx = (Bit32u)((op_pt->wfpos+(mod ? mod[m]*FIXEDPT : 0))/FIXEDPT);
+		wf[m] = op_pt->cur_wform[idx&op_pt->cur_wmask];
+		sa[m] = op_pt->step_amp*op_pt->vol;
+	}
+	// an operator that went off stays off until the next register write
+	for (i=m+1;i<n;i++) operator_advance(op_pt,vib[i]);
+
+	i = 0;
+#ifdef OPL_SSE2
+	const __m128d div16 = _mm_set1_pd(1.0/16.0);
+	for (;i+2<=m;i+=2) {
+		__m128d w = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)&wf[i]));
+		__m128d t = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)&trem[i]));
+		__m128d v = _mm_mul_pd(_mm_loadu_pd(&sa[i]),w);
+		v = _mm_mul_pd(v,_mm_mul_pd(t,div16));
+		_mm_storel_epi64((__m128i*)&out[i],_mm_cvttpd_epi32(v));
+	}
+#endif
+	for (;i<m;i++) out[i] = (Bit32s)(sa[i]*wf[i]*(trem[i]/16.0));
+
+	if (m > 0) {
+		op_pt->lastcval = (m > 1) ? out[m-2] : op_pt->cval;
+		op_pt->cval = out[m-1];
+	}
+	for (i=m;i<n;i++) out[i] = op_pt->cval;
+}
+
 static void change_attackrate(Bitu regbase, op_type* op_pt) {
 	Bits attackrate = adlibreg[ARC_ATTR_DECR+regbase]>>4;
 	if (attackrate) {
@@ -970,6 +1072,9 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 	Bit32s vib_lut[BLOCKBUF_SIZE];
 	Bit32s trem_lut[BLOCKBUF_SIZE];
 
+	// per-operator outputs of the channel being computed
+	Bit32s opbuf[4][BLOCKBUF_SIZE];
+
 	Bits samples_to_process = numsamples;
 	Bits cursmp;
 	for (cursmp=0; cursmp<samples_to_process; cursmp+=endsamples) {
@@ -1012,12 +1117,9 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 					else tremval1 = tremval_const;
 
 					// calculate channel output
+					operator_block(&cptr[9],NULL,vibval1,tremval1,false,opbuf[0],endsamples);
 					for (i=0;i<endsamples;i++) {
-						operator_advance(&cptr[9],vibval1[i]);
-						opfuncs[cptr[9].op_state](&cptr[9]);
-						operator_output(&cptr[9],0,tremval1[i]);
-						
-						Bit32s chanval = cptr[9].cval*2;
+						Bit32s chanval = opbuf[0][i]*2;
 						CHANVAL_OUT
 					}
 				}
@@ -1040,16 +1142,10 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 					else tremval2 = tremval_const;
 
 					// calculate channel output
+					operator_block(&cptr[0],NULL,vibval1,tremval1,true,opbuf[0],endsamples);
+					operator_block(&cptr[9],opbuf[0],vibval2,tremval2,false,opbuf[1],endsamples);
 					for (i=0;i<endsamples;i++) {
-						operator_advance(&cptr[0],vibval1[i]);
-						opfuncs[cptr[0].op_state](&cptr[0]);
-						operator_output(&cptr[0],(cptr[0].lastcval+cptr[0].cval)*cptr[0].mfbi/2,tremval1[i]);
-
-						operator_advance(&cptr[9],vibval2[i]);
-						opfuncs[cptr[9].op_state](&cptr[9]);
-						operator_output(&cptr[9],cptr[0].cval*FIXEDPT,tremval2[i]);
-						
-						Bit32s chanval = cptr[9].cval*2;
+						Bit32s chanval = opbuf[1][i]*2;
 						CHANVAL_OUT
 					}
 				}
@@ -1068,11 +1164,9 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 				else tremval3 = tremval_const;
 
 				// calculate channel output
+				operator_block(&cptr[0],NULL,vibval3,tremval3,false,opbuf[0],endsamples);
 				for (i=0;i<endsamples;i++) {
-					operator_advance(&cptr[0],vibval3[i]);
-					opfuncs[cptr[0].op_state](&cptr[0]);		//TomTom
-					operator_output(&cptr[0],0,tremval3[i]);
-					Bit32s chanval = cptr[0].cval*2;
+					Bit32s chanval = opbuf[0][i]*2;
 					CHANVAL_OUT
 				}
 			}
@@ -1165,12 +1259,9 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval1 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[0],NULL,vibval1,tremval1,true,opbuf[0],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[0],vibval1[i]);
-								opfuncs[cptr[0].op_state](&cptr[0]);
-								operator_output(&cptr[0],(cptr[0].lastcval+cptr[0].cval)*cptr[0].mfbi/2,tremval1[i]);
-
-								Bit32s chanval = cptr[0].cval;
+								Bit32s chanval = opbuf[0][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1187,16 +1278,10 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval2 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[9],NULL,vibval1,tremval1,false,opbuf[0],endsamples);
+							operator_block(&cptr[3],opbuf[0],NULL,tremval2,false,opbuf[1],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[9],vibval1[i]);
-								opfuncs[cptr[9].op_state](&cptr[9]);
-								operator_output(&cptr[9],0,tremval1[i]);
-
-								operator_advance(&cptr[3],0);
-								opfuncs[cptr[3].op_state](&cptr[3]);
-								operator_output(&cptr[3],cptr[9].cval*FIXEDPT,tremval2[i]);
-
-								Bit32s chanval = cptr[3].cval;
+								Bit32s chanval = opbuf[1][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1206,12 +1291,9 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval1 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[3+9],NULL,NULL,tremval1,false,opbuf[0],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[3+9],0);
-								opfuncs[cptr[3+9].op_state](&cptr[3+9]);
-								operator_output(&cptr[3+9],0,tremval1[i]);
-
-								Bit32s chanval = cptr[3+9].cval;
+								Bit32s chanval = opbuf[0][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1227,12 +1309,9 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval1 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[0],NULL,vibval1,tremval1,true,opbuf[0],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[0],vibval1[i]);
-								opfuncs[cptr[0].op_state](&cptr[0]);
-								operator_output(&cptr[0],(cptr[0].lastcval+cptr[0].cval)*cptr[0].mfbi/2,tremval1[i]);
-
-								Bit32s chanval = cptr[0].cval;
+								Bit32s chanval = opbuf[0][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1251,20 +1330,11 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval3 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[9],NULL,vibval1,tremval1,false,opbuf[0],endsamples);
+							operator_block(&cptr[3],opbuf[0],NULL,tremval2,false,opbuf[1],endsamples);
+							operator_block(&cptr[3+9],opbuf[1],NULL,tremval3,false,opbuf[2],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[9],vibval1[i]);
-								opfuncs[cptr[9].op_state](&cptr[9]);
-								operator_output(&cptr[9],0,tremval1[i]);
-
-								operator_advance(&cptr[3],0);
-								opfuncs[cptr[3].op_state](&cptr[3]);
-								operator_output(&cptr[3],cptr[9].cval*FIXEDPT,tremval2[i]);
-
-								operator_advance(&cptr[3+9],0);
-								opfuncs[cptr[3+9].op_state](&cptr[3+9]);
-								operator_output(&cptr[3+9],cptr[3].cval*FIXEDPT,tremval3[i]);
-
-								Bit32s chanval = cptr[3+9].cval;
+								Bit32s chanval = opbuf[2][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1290,18 +1360,10 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 				else tremval2 = tremval_const;
 
 				// calculate channel output
+				operator_block(&cptr[0],NULL,vibval1,tremval1,true,opbuf[0],endsamples);
+				operator_block(&cptr[9],NULL,vibval2,tremval2,false,opbuf[1],endsamples);
 				for (i=0;i<endsamples;i++) {
-					// carrier1
-					operator_advance(&cptr[0],vibval1[i]);
-					opfuncs[cptr[0].op_state](&cptr[0]);
-					operator_output(&cptr[0],(cptr[0].lastcval+cptr[0].cval)*cptr[0].mfbi/2,tremval1[i]);
-
-					// carrier2
-					operator_advance(&cptr[9],vibval2[i]);
-					opfuncs[cptr[9].op_state](&cptr[9]);
-					operator_output(&cptr[9],0,tremval2[i]);
-
-					Bit32s chanval = cptr[9].cval + cptr[0].cval;
+					Bit32s chanval = opbuf[1][i] + opbuf[0][i];
 					CHANVAL_OUT
 				}
 			} else {
@@ -1326,16 +1388,10 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval2 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[0],NULL,vibval1,tremval1,true,opbuf[0],endsamples);
+							operator_block(&cptr[9],opbuf[0],vibval2,tremval2,false,opbuf[1],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[0],vibval1[i]);
-								opfuncs[cptr[0].op_state](&cptr[0]);
-								operator_output(&cptr[0],(cptr[0].lastcval+cptr[0].cval)*cptr[0].mfbi/2,tremval1[i]);
-
-								operator_advance(&cptr[9],vibval2[i]);
-								opfuncs[cptr[9].op_state](&cptr[9]);
-								operator_output(&cptr[9],cptr[0].cval*FIXEDPT,tremval2[i]);
-
-								Bit32s chanval = cptr[9].cval;
+								Bit32s chanval = opbuf[1][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1347,16 +1403,10 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval2 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[3],NULL,NULL,tremval1,false,opbuf[0],endsamples);
+							operator_block(&cptr[3+9],opbuf[0],NULL,tremval2,false,opbuf[1],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[3],0);
-								opfuncs[cptr[3].op_state](&cptr[3]);
-								operator_output(&cptr[3],0,tremval1[i]);
-
-								operator_advance(&cptr[3+9],0);
-								opfuncs[cptr[3+9].op_state](&cptr[3+9]);
-								operator_output(&cptr[3+9],cptr[3].cval*FIXEDPT,tremval2[i]);
-
-								Bit32s chanval = cptr[3+9].cval;
+								Bit32s chanval = opbuf[1][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1385,24 +1435,12 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 							else tremval4 = tremval_const;
 
 							// calculate channel output
+							operator_block(&cptr[0],NULL,vibval1,tremval1,true,opbuf[0],endsamples);
+							operator_block(&cptr[9],opbuf[0],vibval2,tremval2,false,opbuf[1],endsamples);
+							operator_block(&cptr[3],opbuf[1],NULL,tremval3,false,opbuf[2],endsamples);
+							operator_block(&cptr[3+9],opbuf[2],NULL,tremval4,false,opbuf[3],endsamples);
 							for (i=0;i<endsamples;i++) {
-								operator_advance(&cptr[0],vibval1[i]);
-								opfuncs[cptr[0].op_state](&cptr[0]);
-								operator_output(&cptr[0],(cptr[0].lastcval+cptr[0].cval)*cptr[0].mfbi/2,tremval1[i]);
-
-								operator_advance(&cptr[9],vibval2[i]);
-								opfuncs[cptr[9].op_state](&cptr[9]);
-								operator_output(&cptr[9],cptr[0].cval*FIXEDPT,tremval2[i]);
-
-								operator_advance(&cptr[3],0);
-								opfuncs[cptr[3].op_state](&cptr[3]);
-								operator_output(&cptr[3],cptr[9].cval*FIXEDPT,tremval3[i]);
-
-								operator_advance(&cptr[3+9],0);
-								opfuncs[cptr[3+9].op_state](&cptr[3+9]);
-								operator_output(&cptr[3+9],cptr[3].cval*FIXEDPT,tremval4[i]);
-
-								Bit32s chanval = cptr[3+9].cval;
+								Bit32s chanval = opbuf[3][i];
 								CHANVAL_OUT
 							}
 						}
@@ -1428,36 +1466,32 @@ void opl_getsample(Bit16s* sndptr, Bits numsamples) {
 				else tremval2 = tremval_const;
 
 				// calculate channel output
+				operator_block(&cptr[0],NULL,vibval1,tremval1,true,opbuf[0],endsamples);
+				operator_block(&cptr[9],opbuf[0],vibval2,tremval2,false,opbuf[1],endsamples);
 				for (i=0;i<endsamples;i++) {
-					// modulator
-					operator_advance(&cptr[0],vibval1[i]);
-					opfuncs[cptr[0].op_state](&cptr[0]);
-					operator_output(&cptr[0],(cptr[0].lastcval+cptr[0].cval)*cptr[0].mfbi/2,tremval1[i]);
-
-					// carrier
-					operator_advance(&cptr[9],vibval2[i]);
-					opfuncs[cptr[9].op_state](&cptr[9]);
-					operator_output(&cptr[9],cptr[0].cval*FIXEDPT,tremval2[i]);
-
-					Bit32s chanval = cptr[9].cval;
+					Bit32s chanval = opbuf[1][i];
 					CHANVAL_OUT
 				}
 			}
 		}
 
 #if defined(OPLTYPE_IS_OPL3)
-		if (adlibreg[0x105]&1) {
-			// convert to 16bit samples (stereo)
-			for (i=0;i<endsamples;i++) {
-				clipit16(outbufl[i],sndptr++);
-				clipit16(outbufr[i],sndptr++);
-			}
-		} else {
-			// convert to 16bit samples (mono)
-			for (i=0;i<endsamples;i++) {
-				clipit16(outbufl[i],sndptr++);
-				clipit16(outbufl[i],sndptr++);
-			}
+		Bit32s* outr = (adlibreg[0x105]&1) ? outbufr : outbufl;
+		// convert to 16bit samples (stereo, or mono on both sides)
+		i = 0;
+#ifdef OPL_SSE2
+		for (;i+4<=endsamples;i+=4) {
+			__m128i l = _mm_loadu_si128((const __m128i*)&outbufl[i]);
+			__m128i r = _mm_loadu_si128((const __m128i*)&outr[i]);
+			// packssdw saturates exactly like clipit16()
+			_mm_storeu_si128((__m128i*)sndptr,_mm_packs_epi32(
+					_mm_unpacklo_epi32(l,r),_mm_unpackhi_epi32(l,r)));
+			sndptr += 8;
+		}
+#endif
+		for (;i<endsamples;i++) {
+			clipit16(outbufl[i],sndptr++);
+			clipit16(outr[i],sndptr++);
 		}
 #else
 		// convert to 16bit samples
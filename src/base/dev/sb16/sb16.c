@@ -41,6 +41,7 @@
 #include "adlib.h"
 #include "sb16.h"
 #include <string.h>
+#include <assert.h>
 
 static int sb_irq_tab[] = { 2, 5, 7, 10 };
 static int sb_dma_tab[] = { 0, 1, 3 };
@@ -486,6 +487,20 @@ void sb_handle_dma(void)
 	sb.busy = 1;
 }
 
+/* transfers left until the end of the current block */
+int sb_dma_block_left(void)
+{
+    return sb.dma_count + 1;
+}
+
+/* n transfers that don't cross the end of the block */
+void sb_handle_dma_burst(int n)
+{
+    assert(n > 0 && n <= sb.dma_count + 1);
+    sb.dma_count -= n - 1;
+    sb_handle_dma();
+}
+
 void sb_dma_nack(void)
 {
     /* speedy reprograms DSP without exiting auto-init
@@ -25,6 +25,7 @@
 #include "speaker.h"
 #include "dosemu_config.h"
 #include "sig.h"
+#include "deadline.h"
 
 /* --------------------------------------------------------------------- */
 /*
@@ -390,7 +391,9 @@ void dosemu_sleep(void)
   if (CAN_SLEEP()) {
     uncache_time();
     sigemptyset(&mask);
+    deadline_sleep(1);
     sigsuspend(&mask);
+    deadline_sleep(0);
   }
 }
 
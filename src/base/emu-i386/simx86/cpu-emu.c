@@ -947,6 +947,14 @@ static void print_statistics(void)
 	dbug_printf("Page faults       %16d\n",PageFaults);
 	dbug_printf("Signals received  %16d\n",EmuSignals);
 	dbug_printf("Tree cleanups     %16d\n",TreeCleanups);
+	if (InvalidateFast + InvalidateFull) {
+		unsigned long long k;
+		k = ((long long)InvalidateFast * 100UL) /
+			(long long)(InvalidateFast + InvalidateFull);
+		dbug_printf("Invalidate fast   %16d (%lld%%)\n",
+			    InvalidateFast,k);
+		dbug_printf("Invalidate full   %16d\n",InvalidateFull);
+	}
 #endif
 }
 
@@ -61,6 +61,25 @@ unsigned int mMaxMem = 0;
 int PageFaults = 0;
 static tMpMap *LastMp = NULL;
 
+/* Flat copy of the protection bits of all the MpMaps: one bit for each
+ * page of the 4G space that has translated code on it, so that
+ * e_invalidate() can tell data-only ranges in a few word tests. */
+#define CODEMAP_WORDS	(0x100000 / 32)
+static uint32_t codemap[CODEMAP_WORDS];
+
+static inline int codemap_test(unsigned int page)
+{
+	return (codemap[page >> 5] >> (page & 31)) & 1;
+}
+
+static inline void codemap_set(unsigned int page, int onoff)
+{
+	if (onoff)
+		codemap[page >> 5] |= 1u << (page & 31);
+	else
+		codemap[page >> 5] &= ~(1u << (page & 31));
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 static inline tMpMap *FindM(unsigned int addr)
@@ -82,7 +101,7 @@ static inline tMpMap *FindM(unsigned int addr)
 
 static int AddMpMap(unsigned int addr, unsigned int aend, int onoff)
 {
-	int bs=0, bp=0;
+	int bs=0, bp=0, was;
 	register int page;
 	tMpMap *M;
 
@@ -98,11 +117,14 @@ static int AddMpMap(unsigned int addr, unsigned int aend, int onoff)
 		M->next = MpH; MpH = M;
 		M->mega = (page>>8);
 	    }
+	    was = onoff? set_bit(page&255, M->pagemap) :
+		    clear_bit(page&255, M->pagemap);
+	    /* the returned mask only has room for the first 32 pages */
 	    if (bp < 32) {
-		bs |= (((unsigned)(onoff? set_bit(page&255, M->pagemap) :
-			    clear_bit(page&255, M->pagemap)) & 1) << bp);
+		bs |= (((unsigned)was & 1) << bp);
 		bp++;
 	    }
+	    codemap_set(page, onoff);
 	    if (debug_level('e')>1) {
 		if (addr > mMaxMem) mMaxMem = addr;
 		if (onoff)
@@ -118,27 +140,28 @@ static int AddMpMap(unsigned int addr, unsigned int aend, int onoff)
 
 static inline int e_querymprot(unsigned int addr)
 {
-	register int a2 = addr >> PAGE_SHIFT;
-	tMpMap *M = FindM(addr);
-
-	if (M==NULL) return 0;
-	return test_bit(a2&255, M->pagemap);
+	return codemap_test(addr >> PAGE_SHIFT);
 }
 
 int e_querymprotrange(unsigned int addr, size_t len)
 {
-	int a2l, a2h;
-	tMpMap *M = FindM(addr);
+	unsigned int a2l, a2h, w;
+	uint32_t mask;
 
+	if (len == 0)
+		return 0;
 	a2l = addr >> PAGE_SHIFT;
-	a2h = (addr+len-1) >> PAGE_SHIFT;
-
-	while (M && a2l <= a2h) {
-		if (test_bit(a2l&255, M->pagemap))
+	a2h = (unsigned int)((addr + len - 1) & 0xffffffff) >> PAGE_SHIFT;
+	if (a2h < a2l)		/* wraps at 4G */
+		a2h = 0xfffff;
+	for (w = a2l >> 5; w <= a2h >> 5; w++) {
+		mask = ~0u;
+		if (w == a2l >> 5)
+			mask &= ~0u << (a2l & 31);
+		if (w == a2h >> 5)
+			mask &= ~0u >> (31 - (a2h & 31));
+		if (codemap[w] & mask)
 			return 1;
-		a2l++;
-		if ((a2l&255)==0)
-			M = M->next;
 	}
 	return 0;
 }
@@ -163,8 +186,9 @@ int e_markpage(unsigned int addr, size_t len)
 	while (M && abeg <= aend) {
 		set_bit(abeg&CGRMASK, M->subpage);
 		abeg++;
+		/* the list is not sorted */
 		if ((abeg&CGRMASK) == 0)
-			M = M->next;
+			M = FindM(abeg << CGRAN);
 	}
 	return 1;
 }
@@ -192,8 +216,9 @@ int e_querymark(unsigned int addr, size_t len)
 			return 1;
 		}
 		abeg++;
+		/* the list is not sorted */
 		if ((abeg&CGRMASK) == 0)
-			M = M->next;
+			M = FindM(abeg << CGRAN);
 	}
 	return 0;
 }
@@ -429,6 +454,7 @@ void mprot_end(void)
 	    free(M2);
 	}
 	MpH = LastMp = NULL;
+	memset(codemap, 0, sizeof(codemap));
 }
 
 /////////////////////////////////////////////////////////////////////////////
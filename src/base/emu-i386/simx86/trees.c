@@ -74,6 +74,8 @@ int NodesFound = 0;
 int NodesFastFound = 0;
 int NodesNotFound = 0;
 int TreeCleanups = 0;
+int InvalidateFast = 0;
+int InvalidateFull = 0;
 #endif
 
 TNode *LastXNode = NULL;
@@ -1293,11 +1295,20 @@ void e_invalidate(unsigned data, int cnt)
 		return;
 	/* nothing to invalidate if there are no page protections */
 	if (!e_querymprotrange(data, cnt))
-		return;
+		goto fast;
 	/* for low mappings only invalidate if code, not if data */
 	if (LINEAR2UNIX(data) != MEM_BASE32(data) && !e_querymark(data, cnt))
-		return;
+		goto fast;
+#ifdef PROFILE
+	if (debug_level('e')) InvalidateFull++;
+#endif
 	e_invalidate_full(data, cnt);
+	return;
+fast:
+#ifdef PROFILE
+	if (debug_level('e')) InvalidateFast++;
+#endif
+	return;
 }
 
 /* invalidate and unprotect even if we hit only data.
@@ -1504,6 +1515,7 @@ void InitTrees(void)
 	    TotalNodesParsed = TotalNodesExecd = 0;
 	    NodesFound = NodesFastFound = NodesNotFound = 0;
 	    TreeCleanups = 0;
+	    InvalidateFast = InvalidateFull = 0;
 	}
 #endif
 }
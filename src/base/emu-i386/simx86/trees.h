@@ -112,6 +112,8 @@ extern int NodesFastFound;
 extern int EmuSignals;
 extern int NodesFound;
 extern int TreeCleanups;
+extern int InvalidateFast;
+extern int InvalidateFull;
 
 typedef struct avltr_node
 {
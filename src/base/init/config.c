@@ -182,6 +182,7 @@ void dump_config_status(void (*printfunc)(const char *, ...))
         config.ems_size, config.ems_frame);
     (*print)("umb_a0 %i\numb_b0 %i\numb_f0 %i\ndpmi 0x%x\ndpmi_lin_rsv_base 0x%x\ndpmi_lin_rsv_size 0x%x\npm_dos_api %i\nignore_djgpp_null_derefs %i\n",
         config.umb_a0, config.umb_b0, config.umb_f0, config.dpmi, config.dpmi_lin_rsv_base, config.dpmi_lin_rsv_size, config.pm_dos_api, config.no_null_checks);
+    (*print)("hugepages %d\n", config.hugepages);
     (*print)("mapped_bios %d\nvbios_file %s\n",
         config.mapped_bios, (config.vbios_file ? config.vbios_file :""));
     (*print)("vbios_copy %d\nvbios_seg 0x%x\nvbios_size 0x%x\n",
@@ -250,6 +251,9 @@ void dump_config_status(void (*printfunc)(const char *, ...))
         config.tty_lockdir, config.tty_lockfile, config.tty_lockbinary);
     (*print)("num_ser %d\nnum_lpt %d\nfastfloppy %d\nfull_file_locks %d\n",
         config.num_ser, config.num_lpt, config.fastfloppy, config.full_file_locks);
+    (*print)("disk_cache %d\ndisk_cache_wb %d\n", config.disk_cache,
+        config.disk_cache_wb);
+    (*print)("disk_mmap %d\n", config.disk_mmap);
     (*print)("emusys \"%s\"\n",
         (config.emusys ? config.emusys : ""));
     (*print)("dosbanner %d\nvbios_post %d\ndetach %d\n",
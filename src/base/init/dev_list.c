@@ -60,12 +60,12 @@ struct owned_devices_struct {
 static int current_device = -1;
 
 static struct io_dev_struct io_devices[MAX_IO_DEVICES] = {
-  { "pit",     NULL,         pit_reset,     NULL },
+  { "pit",     NULL,         pit_reset,     pit_done },
   { "cmos",    cmos_init,    cmos_reset,    NULL },
   { "video",   video_post_init, NULL, NULL },
   { "internal_mouse",  dosemu_mouse_init,   NULL, dosemu_mouse_close },
   { "serial",  serial_init,  serial_reset,  serial_close },
-  { "pic",     pic_init,     pic_reset,     NULL },
+  { "pic",     pic_init,     pic_reset,     pic_done },
   { "chipset", chipset_init, NULL,          NULL },
 #if 0
   { "pos",     pos_init,     pos_reset,     NULL },
@@ -84,7 +84,7 @@ static struct io_dev_struct io_devices[MAX_IO_DEVICES] = {
 #endif
   { "packet driver", pkt_init, pkt_reset,   pkt_term },
   { "ne2000",  ne2000_init,  ne2000_reset,  ne2000_done },
-  { "ems",     ems_init,     ems_reset,     NULL },
+  { "ems",     ems_init,     ems_reset,     ems_done },
   { "xms",     xms_init,     xms_reset,     NULL },
   { "dpmi",    dpmi_setup,   dpmi_reset,    NULL },
   { NULL,      NULL,         NULL,          NULL }
@@ -39,6 +39,7 @@
 #include "kvm.h"
 #include "mapping.h"
 #include "vgaemu.h"
+#include "sig.h"
 
 #define GFX_CHARS       0xffa6e
 
@@ -111,13 +112,12 @@ void time_setting_init(void)
  * DANG_BEGIN_FUNCTION timer_interrupt_init
  *
  * description:
- *  Tells the OS to send us periodic timer messages
+ *  Starts the periodic tick and the deadline timer that drives it
  *
  * DANG_END_FUNCTION
  */
 void timer_interrupt_init(void)
 {
-  struct itimerval itv;
   int delta;
 
   delta = (config.update / TIMER_DIVISOR);
@@ -130,13 +130,9 @@ void timer_interrupt_init(void)
     delta = 54925 / TIMER_DIVISOR;
   }
 
-  itv.it_interval.tv_sec = 0;
-  itv.it_interval.tv_usec = delta;
-  itv.it_value.tv_sec = 0;
-  itv.it_value.tv_usec = delta;
   c_printf("TIME: using %d usec for updating ALRM timer\n", delta);
 
-  setitimer(ITIMER_REAL, &itv, NULL);
+  signal_start_tick(delta);
 }
 
 /*
@@ -383,6 +379,8 @@ void low_mem_init(void)
   }
   c_printf("Conventional memory mapped from %p to %p\n", lowmem, mem_base);
   dpmi_set_mem_bases(base2, dpmi_base);
+  if (config.dpmi)
+    mapping_huge_coverage("DPMI pool", dpmi_base, dpmi_mem_size());
 
   /* R/O protect 0xf0000-0xf4000 */
   if (!config.umb_f0)
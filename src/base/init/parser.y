@@ -56,6 +56,7 @@
 #include "cpu-emu.h"
 #endif
 #include "disks.h"
+#include "diskovl.h"
 #include "port.h"
 #define allow_io	port_allow_io
 #include "lpt.h"
@@ -247,11 +248,11 @@ enum {
 %token CHECKUSERVAR
 
 	/* main options */
-%token DOSBANNER FASTFLOPPY HOGTHRESH SPEAKER IPXSUPPORT IPXNETWORK NOVELLHACK
+%token DOSBANNER FASTFLOPPY DISK_CACHE DISK_CACHE_WB DISK_MMAP HOGTHRESH SPEAKER IPXSUPPORT IPXNETWORK NOVELLHACK
 %token ETHDEV TAPDEV VDESWITCH SLIRPARGS VNET
 %token DEBUG MOUSE SERIAL COM KEYBOARD TERMINAL VIDEO EMURETRACE TIMER
 %token MATHCO CPU CPUSPEED RDTSC BOOTDRIVE SWAP_BOOTDRIVE
-%token L_XMS L_DPMI DPMI_LIN_RSV_BASE DPMI_LIN_RSV_SIZE PM_DOS_API NO_NULL_CHECKS
+%token L_XMS L_DPMI DPMI_LIN_RSV_BASE DPMI_LIN_RSV_SIZE PM_DOS_API NO_NULL_CHECKS HUGEPAGES
 %token PORTS DISK DOSMEM EXT_MEM
 %token L_EMS UMB_A0 UMB_B0 UMB_F0 EMS_SIZE EMS_FRAME EMS_UMA_PAGES EMS_CONV_PAGES
 %token TTYLOCKS L_SOUND L_SND_OSS L_JOYSTICK FULL_FILE_LOCKS
@@ -302,6 +303,7 @@ enum {
 	/* disk */
 %token L_PARTITION WHOLEDISK THREEINCH THREEINCH_720 THREEINCH_2880 FIVEINCH FIVEINCH_360 READONLY LAYOUT
 %token SECTORS CYLINDERS TRACKS HEADS OFFSET HDIMAGE HDTYPE1 HDTYPE2 HDTYPE9 DISKCYL4096
+%token OVERLAY OVERLAY_MODE
 %token DEFAULT_DRIVES SKIP_DRIVES
 	/* ports/io */
 %token RDONLY WRONLY RDWR ORMASK ANDMASK RANGE FAST SLOW
@@ -472,6 +474,22 @@ line:		CHARSET '{' charset_flags '}' {}
 			config.fastfloppy = ($2!=0);
 			c_printf("CONF: fastfloppy = %d\n", config.fastfloppy);
 			}
+		| DISK_CACHE int_bool
+			{
+			config.disk_cache = $2;
+			c_printf("CONF: disk cache %dK\n", config.disk_cache);
+			}
+		| DISK_CACHE_WB bool
+			{
+			config.disk_cache_wb = ($2!=0);
+			c_printf("CONF: disk cache write-back = %d\n",
+				 config.disk_cache_wb);
+			}
+		| DISK_MMAP int_bool
+			{
+			config.disk_mmap = $2;
+			c_printf("CONF: mmap disk images up to %dK\n", config.disk_mmap);
+			}
 		| CPU expression
 			{
 			int cpu = cpu_override (($2%100)==86?($2/100)%10:0);
@@ -670,6 +688,11 @@ line:		CHARSET '{' charset_flags '}' {}
 		    config.no_null_checks = ($2!=0);
 		    c_printf("CONF: No DJGPP NULL deref checks: %s\n", ($2) ? "on" : "off");
 		    }
+		| HUGEPAGES bool
+		    {
+		    config.hugepages = ($2!=0);
+		    c_printf("CONF: huge pages %s\n", ($2) ? "on" : "off");
+		    }
 		| DOSMEM int_bool	{ if ($2>=0) config.mem_size = $2; }
 		| EXT_MEM int_bool
 		    {
@@ -1549,6 +1572,22 @@ disk_flag	: READONLY		{ dptr->wantrdonly = 1; }
 		| TRACKS expression	{ dptr->tracks = $2; }
 		| HEADS expression		{ dptr->heads = $2; }
 		| OFFSET expression	{ dptr->header = $2; }
+		| OVERLAY string_expr
+		  {
+		  free(dptr->ovl_name);
+		  dptr->ovl_name = $2;
+		  if (dptr->ovl_mode == DOVL_NONE)
+		    dptr->ovl_mode = DOVL_KEEP;
+		  }
+		| OVERLAY_MODE string_expr
+		  {
+		  int mode = dovl_parse_mode($2);
+		  if (mode == -1)
+		    yyerror("unrecognized overlay mode '%s'", $2);
+		  else
+		    dptr->ovl_mode = mode;
+		  free($2);
+		  }
 		| DEVICE string_expr
 		  {
 		  if (dptr->dev_name != NULL)
@@ -2133,6 +2172,8 @@ static void dp_init(struct disk *dptr)
   dptr->dev_name = NULL;              /* default-values */
   dptr->wantrdonly = 0;
   dptr->header = 0;
+  dptr->ovl_name = NULL;
+  dptr->ovl_mode = DOVL_NONE;
 }
 
 static void start_disk(void)
@@ -2264,6 +2305,15 @@ static void stop_disk(int token)
     }
   }
 
+  if (dptr->ovl_mode != DOVL_NONE) {
+    if (token == L_FLOPPY || dptr->type != IMAGE) {
+      yywarn("disk: overlay is only supported for hdimages, ignored");
+      dptr->ovl_mode = DOVL_NONE;
+    } else {
+      c_printf(" overlay %s", dptr->ovl_name ?: "(tmp)");
+    }
+  }
+
   if (token == L_FLOPPY) {
     c_printf(" floppy %c:\n", 'A'+c_fdisks);
     disktab[c_fdisks].drive_num = c_fdisks;
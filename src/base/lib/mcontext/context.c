@@ -34,7 +34,9 @@ void makemcontext(m_ucontext_t *ucp, void (*func)(void*), void *arg)
 
 int swapmcontext(m_ucontext_t *oucp, const m_ucontext_t *ucp)
 {
-	if(getmcontext(oucp) == 0)
+	/* no need to clear the context first: setmcontext() only
+	 * loads what _getmcontext() stores */
+	if(_getmcontext(&oucp->uc_mcontext) == 0)
 		setmcontext(ucp);
 	return 0;
 }
@@ -0,0 +1,85 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: latency histograms for the timing statistics.
+ */
+
+#include <string.h>
+#include "bitops.h"
+#include "latstat.h"
+
+static int lat_bucket(unsigned val)
+{
+  int e;
+
+  if (val < (1 << LAT_SUB_BITS))
+    return val;
+  e = find_bit_r(val);
+  return ((e - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+      ((val >> (e - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1));
+}
+
+/* largest value that goes to the bucket */
+static unsigned lat_bucket_max(int idx)
+{
+  int e, sub;
+
+  if (idx < (1 << LAT_SUB_BITS))
+    return idx;
+  e = (idx >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+  sub = idx & ((1 << LAT_SUB_BITS) - 1);
+  return (((1u << LAT_SUB_BITS) + sub) << (e - LAT_SUB_BITS)) +
+      (1u << (e - LAT_SUB_BITS)) - 1;
+}
+
+void lat_add(struct lat_stat *ls, unsigned val)
+{
+  ls->count++;
+  ls->sum += val;
+  if (val > ls->max)
+    ls->max = val;
+  ls->hist[lat_bucket(val)]++;
+}
+
+unsigned lat_percentile(const struct lat_stat *ls, int pct)
+{
+  unsigned long long want, seen = 0;
+  int i;
+
+  if (!ls->count)
+    return 0;
+  want = (ls->count * pct + 99) / 100;
+  for (i = 0; i < LAT_BUCKETS; i++) {
+    seen += ls->hist[i];
+    if (seen >= want)
+      break;
+  }
+  if (i == LAT_BUCKETS)
+    return ls->max;
+  /* the bucket may be wider than what was actually seen */
+  return (lat_bucket_max(i) < ls->max ? lat_bucket_max(i) : ls->max);
+}
+
+unsigned lat_mean(const struct lat_stat *ls)
+{
+  return (ls->count ? ls->sum / ls->count : 0);
+}
+
+void lat_reset(struct lat_stat *ls)
+{
+  memset(ls, 0, sizeof(*ls));
+}
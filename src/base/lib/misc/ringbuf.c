@@ -180,6 +180,69 @@ void rng_clear(struct rng_s *rng)
 }
 
 
+/* Lock-free ring for exactly one producer and one consumer thread.
+ * head is only written by the producer and tail only by the consumer,
+ * both run freely and are masked on access, so objnum must be a power
+ * of 2. Neither side ever waits for the other. */
+
+void spsc_init(struct spsc_s *rng, size_t objnum, size_t objsize)
+{
+  assert(objnum && !(objnum & (objnum - 1)));
+  rng->buffer = calloc(objnum, objsize);
+  assert(rng->buffer);
+  rng->objnum = objnum;
+  rng->objsize = objsize;
+  rng->head = rng->tail = 0;
+}
+
+void spsc_destroy(struct spsc_s *rng)
+{
+  free(rng->buffer);
+  rng->buffer = NULL;
+}
+
+int spsc_put(struct spsc_s *rng, const void *obj)
+{
+  unsigned int head = rng->head;
+  unsigned int tail = __atomic_load_n(&rng->tail, __ATOMIC_ACQUIRE);
+
+  if (head - tail >= rng->objnum)
+    return 0;
+  memcpy(rng->buffer + (head & (rng->objnum - 1)) * rng->objsize, obj,
+      rng->objsize);
+  __atomic_store_n(&rng->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+int spsc_peek(struct spsc_s *rng, void *buf)
+{
+  unsigned int tail = rng->tail;
+  unsigned int head = __atomic_load_n(&rng->head, __ATOMIC_ACQUIRE);
+
+  if (head == tail)
+    return 0;
+  memcpy(buf, rng->buffer + (tail & (rng->objnum - 1)) * rng->objsize,
+      rng->objsize);
+  return 1;
+}
+
+int spsc_get(struct spsc_s *rng, void *buf)
+{
+  if (buf && !spsc_peek(rng, buf))
+    return 0;
+  if (!buf && !spsc_count(rng))
+    return 0;
+  __atomic_store_n(&rng->tail, rng->tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+int spsc_count(struct spsc_s *rng)
+{
+  return __atomic_load_n(&rng->head, __ATOMIC_ACQUIRE) -
+      __atomic_load_n(&rng->tail, __ATOMIC_ACQUIRE);
+}
+
+
 /* sequential buffer API */
 
 #define SQALIGN(x) (ALIGN(x, sizeof(struct seqitem)))
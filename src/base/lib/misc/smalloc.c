@@ -18,6 +18,13 @@
  * smalloc - small memory allocator for dosemu.
  *
  * Author: Stas Sergeev
+ *
+ * The memnodes form an address-ordered list that covers the whole pool.
+ * Allocation is first-fit by address, as DPMI clients rely on that.
+ * To keep it fast with many areas the memnodes are also kept in a
+ * treap keyed by address, where every node knows the largest free area
+ * in its subtree. This gives O(log n) lookups by address and of the
+ * lowest free area of the given size.
  */
 
 #include <stdio.h>
@@ -121,7 +128,127 @@ static int sm_commit_simple(struct mempool *mp, void *addr, size_t size)
   return sm_commit(mp, addr, size, NULL, 0);
 }
 
-static void mntruncate(struct memnode *pmn, size_t size)
+static unsigned mn_random(void)
+{
+  static unsigned seed = 2463534242u;
+
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static void mn_fix(struct memnode *mn)
+{
+  size_t m = mn->used ? 0 : mn->size;
+
+  if (mn->left && mn->left->max_free > m)
+    m = mn->left->max_free;
+  if (mn->right && mn->right->max_free > m)
+    m = mn->right->max_free;
+  mn->max_free = m;
+}
+
+/* size or used of mn changed: update the subtree maximums */
+static void mn_fix_up(struct memnode *mn)
+{
+  for (; mn; mn = mn->parent)
+    mn_fix(mn);
+}
+
+static void mn_set_used(struct memnode *mn, int used)
+{
+  mn->used = used;
+  mn_fix_up(mn);
+}
+
+static void mn_replace_child(struct mempool *mp, struct memnode *p,
+    struct memnode *old, struct memnode *mn)
+{
+  if (!p)
+    mp->root = mn;
+  else if (p->left == old)
+    p->left = mn;
+  else
+    p->right = mn;
+}
+
+/* rotate mn one level up, above its parent */
+static void mn_rotate_up(struct mempool *mp, struct memnode *mn)
+{
+  struct memnode *p = mn->parent;
+  struct memnode *g = p->parent;
+
+  if (p->left == mn) {
+    p->left = mn->right;
+    if (p->left)
+      p->left->parent = p;
+    mn->right = p;
+  } else {
+    p->right = mn->left;
+    if (p->right)
+      p->right->parent = p;
+    mn->left = p;
+  }
+  p->parent = mn;
+  mn->parent = g;
+  mn_replace_child(mp, g, p, mn);
+  mn_fix(p);
+  mn_fix(mn);
+}
+
+/* nmn was just linked in the list right after pmn */
+static void mn_insert_after(struct mempool *mp, struct memnode *pmn,
+    struct memnode *nmn)
+{
+  struct memnode *p;
+
+  nmn->left = nmn->right = NULL;
+  nmn->prio = mn_random();
+  if (!pmn->right) {
+    pmn->right = nmn;
+    p = pmn;
+  } else {
+    for (p = pmn->right; p->left; p = p->left);
+    p->left = nmn;
+  }
+  nmn->parent = p;
+  while (nmn->parent && nmn->parent->prio > nmn->prio)
+    mn_rotate_up(mp, nmn);
+  mn_fix_up(nmn);
+}
+
+static void mn_remove(struct mempool *mp, struct memnode *mn)
+{
+  struct memnode *p;
+
+  while (mn->left || mn->right) {
+    struct memnode *c;
+    if (!mn->left)
+      c = mn->right;
+    else if (!mn->right)
+      c = mn->left;
+    else
+      c = mn->left->prio < mn->right->prio ? mn->left : mn->right;
+    mn_rotate_up(mp, c);
+  }
+  p = mn->parent;
+  mn_replace_child(mp, p, mn, NULL);
+  mn_fix_up(p);
+}
+
+static struct memnode *mn_prev(struct memnode *mn)
+{
+  if (mn->left) {
+    for (mn = mn->left; mn->right; mn = mn->right);
+    return mn;
+  }
+  while (mn->parent && mn->parent->left == mn)
+    mn = mn->parent;
+  return mn->parent;
+}
+
+static void mntruncate(struct mempool *mp, struct memnode *pmn, size_t size)
 {
   int delta = pmn->size - size;
 
@@ -138,9 +265,13 @@ static void mntruncate(struct memnode *pmn, size_t size)
     pmn->size -= delta;
     if (nmn->size == 0) {
       pmn->next = nmn->next;
+      mn_remove(mp, nmn);
       free(nmn);
       assert(!pmn->next || pmn->next->used);
+    } else {
+      mn_fix_up(nmn);
     }
+    mn_fix_up(pmn);
   } else {
     struct memnode *new_mn;
 
@@ -154,49 +285,61 @@ static void mntruncate(struct memnode *pmn, size_t size)
 
     pmn->next = new_mn;
     pmn->size = size;
+    mn_insert_after(mp, pmn, new_mn);
+    mn_fix_up(pmn);
   }
 }
 
 static struct memnode *find_mn(struct mempool *mp, unsigned char *ptr,
     struct memnode **prev)
 {
-  struct memnode *pmn, *mn;
+  struct memnode *mn;
   if (!POOL_USED(mp)) {
     smerror(mp, "SMALLOC: unused pool passed\n");
     return NULL;
   }
-  for (pmn = NULL, mn = &mp->mn; mn; pmn = mn, mn = mn->next) {
-    if (mn->mem_area > ptr)
-      return NULL;
+  for (mn = mp->root; mn;) {
     if (mn->mem_area == ptr) {
       if (prev)
-        *prev = pmn;
+        *prev = mn_prev(mn);
       return mn;
     }
+    mn = (ptr < mn->mem_area ? mn->left : mn->right);
   }
   return NULL;
 }
 
 static struct memnode *find_mn_at(struct mempool *mp, unsigned char *ptr)
 {
-  struct memnode *mn;
-  for (mn = &mp->mn; mn; mn = mn->next) {
-    if (mn->mem_area > ptr)
-      return NULL;
-    if (mn->mem_area + mn->size > ptr)
-      return mn;
+  struct memnode *mn, *found = NULL;
+  /* find the last memnode that starts at or below ptr */
+  for (mn = mp->root; mn;) {
+    if (mn->mem_area > ptr) {
+      mn = mn->left;
+    } else {
+      found = mn;
+      mn = mn->right;
+    }
   }
+  if (found && found->mem_area + found->size > ptr)
+    return found;
   return NULL;
 }
 
+/* lowest free area that fits */
 static struct memnode *smfind_free_area(struct mempool *mp, size_t size)
 {
-  struct memnode *mn;
-  for (mn = &mp->mn; mn; mn = mn->next) {
-    if (!mn->used && mn->size >= size)
+  struct memnode *mn = mp->root;
+  if (!mn || mn->max_free < size)
+    return NULL;
+  while (1) {
+    if (mn->left && mn->left->max_free >= size)
+      mn = mn->left;
+    else if (!mn->used && mn->size >= size)
       return mn;
+    else
+      mn = mn->right;
   }
-  return NULL;
 }
 
 static struct memnode *sm_alloc_mn(struct mempool *mp, size_t size)
@@ -213,10 +356,11 @@ static struct memnode *sm_alloc_mn(struct mempool *mp, size_t size)
   }
   if (!sm_commit_simple(mp, mn->mem_area, size))
     return NULL;
-  mn->used = 1;
-  mntruncate(mn, size);
+  mn_set_used(mn, 1);
+  mntruncate(mp, mn, size);
   assert(mn->size == size);
-  memset(mn->mem_area, 0, size);
+  if (!(mp->flags & SM_ZEROED_COMMIT))
+    memset(mn->mem_area, 0, size);
   return mn;
 }
 
@@ -244,16 +388,17 @@ static struct memnode *sm_alloc_fixed(struct mempool *mp, void *ptr,
     return NULL;
   }
   if (delta) {
-    mntruncate(mn, delta);
+    mntruncate(mp, mn, delta);
     mn = mn->next;
     assert(!mn->used && mn->size >= size);
   }
   if (!sm_commit_simple(mp, mn->mem_area, size))
     return NULL;
-  mn->used = 1;
-  mntruncate(mn, size);
+  mn_set_used(mn, 1);
+  mntruncate(mp, mn, size);
   assert(mn->size == size);
-  memset(mn->mem_area, 0, size);
+  if (!(mp->flags & SM_ZEROED_COMMIT))
+    memset(mn->mem_area, 0, size);
   return mn;
 }
 
@@ -289,16 +434,16 @@ int smfree(struct mempool *mp, void *ptr)
   }
   assert(mn->size > 0);
   sm_uncommit(mp, mn->mem_area, mn->size);
-  mn->used = 0;
+  mn_set_used(mn, 0);
   if (mn->next && !mn->next->used) {
     /* merge with next */
     assert(mn->next->mem_area >= mn->mem_area);
-    mntruncate(mn, mn->size + mn->next->size);
+    mntruncate(mp, mn, mn->size + mn->next->size);
   }
   if (pmn && !pmn->used) {
     /* merge with prev */
     assert(pmn->mem_area <= mn->mem_area);
-    mntruncate(pmn, pmn->size + mn->size);
+    mntruncate(mp, pmn, pmn->size + mn->size);
     mn = pmn;
   }
   return 0;
@@ -312,7 +457,7 @@ static struct memnode *sm_realloc_alloc_mn(struct mempool *mp,
 {
   struct memnode *new_mn;
   if (pmn && !pmn->used && pmn->size + mn->size +
-	(nmn->used ? 0 : nmn->size) >= size) {
+	(!nmn || nmn->used ? 0 : nmn->size) >= size) {
     /* move to prev memnode */
     size_t psize = min(size, pmn->size);
     if (!sm_commit_simple(mp, pmn->mem_area, psize))
@@ -322,17 +467,18 @@ static struct memnode *sm_realloc_alloc_mn(struct mempool *mp,
 	    pmn->mem_area, psize))
         return NULL;
     }
-    pmn->used = 1;
+    mn_set_used(pmn, 1);
     memmove(pmn->mem_area, mn->mem_area, mn->size);
+    /* the tail may overlap the old data */
     memset(pmn->mem_area + mn->size, 0, size - mn->size);
-    mn->used = 0;
+    mn_set_used(mn, 0);
     if (size < pmn->size + mn->size) {
       size_t overl = size > pmn->size ? size - pmn->size : 0;
       sm_uncommit(mp, mn->mem_area + overl, mn->size - overl);
     }
-    if (!nmn->used)	// merge with next
-      mntruncate(mn, mn->size + nmn->size);
-    mntruncate(pmn, size);
+    if (nmn && !nmn->used)	// merge with next
+      mntruncate(mp, mn, mn->size + nmn->size);
+    mntruncate(mp, pmn, size);
     new_mn = pmn;
   } else {
     /* relocate */
@@ -370,7 +516,7 @@ void *smrealloc(struct mempool *mp, void *ptr, size_t size)
   if (size < mn->size) {
     /* shrink */
     sm_uncommit(mp, mn->mem_area + size, mn->size - size);
-    mntruncate(mn, size);
+    mntruncate(mp, mn, size);
   } else {
     /* grow */
     struct memnode *nmn = mn->next;
@@ -378,8 +524,9 @@ void *smrealloc(struct mempool *mp, void *ptr, size_t size)
       /* expand by shrinking next memnode */
       if (!sm_commit_simple(mp, nmn->mem_area, size - mn->size))
         return NULL;
-      memset(nmn->mem_area, 0, size - mn->size);
-      mntruncate(mn, size);
+      if (!(mp->flags & SM_ZEROED_COMMIT))
+        memset(nmn->mem_area, 0, size - mn->size);
+      mntruncate(mp, mn, size);
     } else {
       /* need to allocate new memnode */
       mn = sm_realloc_alloc_mn(mp, pmn, mn, nmn, size);
@@ -398,6 +545,11 @@ int sminit(struct mempool *mp, void *start, size_t size)
   mp->mn.used = 0;
   mp->mn.next = NULL;
   mp->mn.mem_area = (unsigned char *)start;
+  mp->mn.left = mp->mn.right = mp->mn.parent = NULL;
+  mp->mn.max_free = size;
+  mp->mn.prio = mn_random();
+  mp->root = &mp->mn;
+  mp->flags = 0;
   mp->avail = size;
   mp->commit = NULL;
   mp->uncommit = NULL;
@@ -415,6 +567,11 @@ int sminit_com(struct mempool *mp, void *start, size_t size,
   return 0;
 }
 
+void smset_flags(struct mempool *mp, int flags)
+{
+  mp->flags = flags;
+}
+
 void smfree_all(struct mempool *mp)
 {
   struct memnode *mn;
@@ -445,13 +602,7 @@ size_t smget_free_space(struct mempool *mp)
 
 size_t smget_largest_free_area(struct mempool *mp)
 {
-  struct memnode *mn;
-  size_t size = 0;
-  for (mn = &mp->mn; mn; mn = mn->next) {
-    if (!mn->used && mn->size > size)
-      size = mn->size;
-  }
-  return size;
+  return mp->root ? mp->root->max_free : 0;
 }
 
 int smget_area_size(struct mempool *mp, void *ptr)
@@ -0,0 +1,474 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: block cache for disk images.
+ *
+ * INT13 traffic during boot and install is dominated by small, repeated
+ * reads of FAT and directory sectors. We keep a fixed pool of 4K blocks
+ * keyed by file offset, evict in LRU order and widen the fill window
+ * while the guest reads sequentially.
+ *
+ * Writes go straight to the file and update the blocks that are
+ * already cached. In write-back mode they are deferred until the next
+ * flush instead. A block whose write-back fails stays dirty, and the
+ * error is returned by the following writes until a flush succeeds.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <assert.h>
+#include "dosemu_debug.h"
+#include "diskcache.h"
+
+#define DC_RA_MIN	4
+#define DC_RA_MAX	32
+#define DC_MAX_FILL	(DC_RA_MAX * 2)
+#define DC_NO_BLK	((uint64_t)-1)
+
+struct dc_block {
+  uint64_t blk;
+  unsigned char *data;
+  int valid;			/* bytes backed by the file */
+  int dirty;
+  int ra;			/* fetched by readahead, not yet used */
+  struct dc_block *hnext;
+  struct dc_block *prev, *next;	/* LRU list */
+};
+
+struct disk_cache {
+  dcache_io_t rd;
+  dcache_io_t wr;
+  void *arg;
+  int wb;
+  int wr_err;			/* errno of a failed write-back */
+  int nblocks;
+  unsigned hmask;
+  struct dc_block **hash;
+  struct dc_block *blocks;
+  unsigned char *mem;
+  struct dc_block lru;		/* lru.next is MRU, lru.prev is LRU */
+  uint64_t next_blk;		/* expected block of a sequential read */
+  int ra_win;
+  struct dcache_stats st;
+};
+
+static unsigned dc_hash(const struct disk_cache *dc, uint64_t blk)
+{
+  return (blk ^ (blk >> 16)) & dc->hmask;
+}
+
+static void lru_unlink(struct dc_block *b)
+{
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+}
+
+static void lru_push_front(struct disk_cache *dc, struct dc_block *b)
+{
+  b->next = dc->lru.next;
+  b->prev = &dc->lru;
+  dc->lru.next->prev = b;
+  dc->lru.next = b;
+}
+
+static void lru_push_back(struct disk_cache *dc, struct dc_block *b)
+{
+  b->prev = dc->lru.prev;
+  b->next = &dc->lru;
+  dc->lru.prev->next = b;
+  dc->lru.prev = b;
+}
+
+static struct dc_block *dc_lookup(struct disk_cache *dc, uint64_t blk)
+{
+  struct dc_block *b;
+
+  for (b = dc->hash[dc_hash(dc, blk)]; b; b = b->hnext) {
+    if (b->blk == blk)
+      return b;
+  }
+  return NULL;
+}
+
+static void dc_hash_insert(struct disk_cache *dc, struct dc_block *b,
+    uint64_t blk)
+{
+  unsigned h = dc_hash(dc, blk);
+
+  b->blk = blk;
+  b->hnext = dc->hash[h];
+  dc->hash[h] = b;
+}
+
+static void dc_hash_remove(struct disk_cache *dc, struct dc_block *b)
+{
+  struct dc_block **p = &dc->hash[dc_hash(dc, b->blk)];
+
+  while (*p != b)
+    p = &(*p)->hnext;
+  *p = b->hnext;
+  b->blk = DC_NO_BLK;
+}
+
+static int dc_writeback(struct disk_cache *dc, struct dc_block *b)
+{
+  struct iovec iov = { .iov_base = b->data, .iov_len = b->valid };
+  ssize_t ret;
+
+  ret = dc->wr(dc->arg, &iov, 1, b->blk << DCACHE_BLK_SHIFT);
+  dc->st.pwrites++;
+  if (ret != b->valid) {
+    dc->wr_err = ret < 0 ? errno : EIO;
+    error("DISK: write-back of block %#"PRIx64" failed: %s\n", b->blk,
+        strerror(dc->wr_err));
+    return -1;
+  }
+  dc->st.writebacks++;
+  b->dirty = 0;
+  return 0;
+}
+
+/* take the least recently used block that can be dropped out of the
+ * cache; a dirty block that can not be written back is kept */
+static struct dc_block *dc_get_free(struct disk_cache *dc)
+{
+  struct dc_block *b;
+  int i;
+
+  for (i = 0; i < dc->nblocks; i++) {
+    b = dc->lru.prev;
+    assert(b != &dc->lru);
+    lru_unlink(b);
+    if (!b->dirty || dc_writeback(dc, b) == 0)
+      break;
+    lru_push_front(dc, b);
+  }
+  if (i == dc->nblocks) {
+    errno = dc->wr_err;
+    return NULL;
+  }
+  if (b->blk != DC_NO_BLK)
+    dc_hash_remove(dc, b);
+  b->valid = 0;
+  b->dirty = 0;
+  b->ra = 0;
+  return b;
+}
+
+/* read up to count absent blocks starting at blk with a single syscall */
+static int dc_fill(struct disk_cache *dc, uint64_t blk, int count)
+{
+  struct dc_block *b[DC_MAX_FILL];
+  struct iovec iov[DC_MAX_FILL];
+  ssize_t ret;
+  int i, n;
+
+  if (count > DC_MAX_FILL)
+    count = DC_MAX_FILL;
+  if (count > dc->nblocks / 2)
+    count = dc->nblocks / 2;
+  if (count < 1)
+    count = 1;
+  for (n = 0; n < count; n++) {
+    if (n && dc_lookup(dc, blk + n))
+      break;
+    b[n] = dc_get_free(dc);
+    if (!b[n])
+      break;
+    iov[n].iov_base = b[n]->data;
+    iov[n].iov_len = DCACHE_BLK_SIZE;
+  }
+
+  if (!n)
+    return -1;
+  ret = dc->rd(dc->arg, iov, n, blk << DCACHE_BLK_SHIFT);
+  dc->st.preads++;
+  if (ret < 0) {
+    for (i = 0; i < n; i++)
+      lru_push_back(dc, b[i]);
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    ssize_t left = ret - (ssize_t)i * DCACHE_BLK_SIZE;
+
+    /* past EOF: only the requested block is kept, as an empty one */
+    if (i && left <= 0) {
+      lru_push_back(dc, b[i]);
+      continue;
+    }
+    b[i]->valid = left < 0 ? 0 :
+        (left > DCACHE_BLK_SIZE ? DCACHE_BLK_SIZE : left);
+    b[i]->ra = (i > 0);
+    if (i)
+      dc->st.ra_blocks++;
+    dc_hash_insert(dc, b[i], blk + i);
+    lru_push_front(dc, b[i]);
+  }
+  return 0;
+}
+
+/* make blk resident; nreq is the number of blocks the request still needs */
+static struct dc_block *dc_get(struct disk_cache *dc, uint64_t blk, int nreq)
+{
+  struct dc_block *b = dc_lookup(dc, blk);
+
+  if (b) {
+    dc->st.hits++;
+    if (b->ra) {
+      dc->st.ra_hits++;
+      b->ra = 0;
+    }
+    lru_unlink(b);
+    lru_push_front(dc, b);
+    return b;
+  }
+
+  dc->st.misses++;
+  if (blk == dc->next_blk) {
+    dc->ra_win = dc->ra_win ? dc->ra_win * 2 : DC_RA_MIN;
+    if (dc->ra_win > DC_RA_MAX)
+      dc->ra_win = DC_RA_MAX;
+  } else {
+    dc->ra_win = 0;
+  }
+  if (dc_fill(dc, blk, nreq + dc->ra_win) == -1)
+    return NULL;
+  return dc_lookup(dc, blk);
+}
+
+ssize_t dcache_pread(struct disk_cache *dc, void *buf, size_t len, off_t pos)
+{
+  unsigned char *p = buf;
+  size_t done = 0;
+
+  while (done < len) {
+    uint64_t blk = pos >> DCACHE_BLK_SHIFT;
+    int off = pos & (DCACHE_BLK_SIZE - 1);
+    int nreq = (off + len - done + DCACHE_BLK_SIZE - 1) >> DCACHE_BLK_SHIFT;
+    struct dc_block *b = dc_get(dc, blk, nreq);
+    size_t n;
+
+    if (!b)
+      return done ? done : -1;
+    if (off >= b->valid)
+      break;
+    n = b->valid - off;
+    if (n > len - done)
+      n = len - done;
+    memcpy(p + done, b->data + off, n);
+    done += n;
+    pos += n;
+    if (off + n < DCACHE_BLK_SIZE)
+      break;
+  }
+  dc->next_blk = (pos + DCACHE_BLK_SIZE - 1) >> DCACHE_BLK_SHIFT;
+  return done;
+}
+
+/* write-through: the file first, then the blocks already cached */
+static ssize_t dc_pwrite_through(struct disk_cache *dc, const void *buf,
+    size_t len, off_t pos)
+{
+  struct iovec iov = { .iov_base = (void *)(uintptr_t)buf, .iov_len = len };
+  const unsigned char *p = buf;
+  ssize_t ret, done = 0;
+
+  ret = dc->wr(dc->arg, &iov, 1, pos);
+  dc->st.pwrites++;
+  if (ret <= 0)
+    return ret;
+  while (done < ret) {
+    uint64_t blk = pos >> DCACHE_BLK_SHIFT;
+    int off = pos & (DCACHE_BLK_SIZE - 1);
+    ssize_t n = DCACHE_BLK_SIZE - off;
+    struct dc_block *b = dc_lookup(dc, blk);
+
+    if (n > ret - done)
+      n = ret - done;
+    if (b) {
+      dc->st.hits++;
+      lru_unlink(b);
+      lru_push_front(dc, b);
+      b->ra = 0;
+      /* a write past the old end of file leaves a hole of zeroes */
+      if (off > b->valid)
+        memset(b->data + b->valid, 0, off - b->valid);
+      memcpy(b->data + off, p + done, n);
+      if (off + n > b->valid)
+        b->valid = off + n;
+    }
+    done += n;
+    pos += n;
+  }
+  return ret;
+}
+
+ssize_t dcache_pwrite(struct disk_cache *dc, const void *buf, size_t len,
+    off_t pos)
+{
+  const unsigned char *p = buf;
+  size_t done = 0;
+
+  if (dc->wr_err) {
+    errno = dc->wr_err;
+    return -1;
+  }
+  if (!dc->wb)
+    return dc_pwrite_through(dc, buf, len, pos);
+  while (done < len) {
+    uint64_t blk = pos >> DCACHE_BLK_SHIFT;
+    int off = pos & (DCACHE_BLK_SIZE - 1);
+    size_t n = DCACHE_BLK_SIZE - off;
+    struct dc_block *b;
+
+    if (n > len - done)
+      n = len - done;
+    b = dc_lookup(dc, blk);
+    if (b) {
+      dc->st.hits++;
+      lru_unlink(b);
+      lru_push_front(dc, b);
+    } else if (n == DCACHE_BLK_SIZE) {
+      /* full overwrite, no need to read the old contents */
+      dc->st.misses++;
+      b = dc_get_free(dc);
+      if (!b)
+        return done ? done : -1;
+      dc_hash_insert(dc, b, blk);
+      lru_push_front(dc, b);
+    } else {
+      b = dc_get(dc, blk, 1);
+      if (!b)
+        return done ? done : -1;
+    }
+    b->ra = 0;
+    if (off > b->valid)
+      memset(b->data + b->valid, 0, off - b->valid);
+    memcpy(b->data + off, p + done, n);
+    if (off + n > b->valid)
+      b->valid = off + n;
+    b->dirty = 1;
+    done += n;
+    pos += n;
+  }
+  return done;
+}
+
+static int blk_cmp(const void *a, const void *b)
+{
+  const struct dc_block *b1 = *(struct dc_block * const *)a;
+  const struct dc_block *b2 = *(struct dc_block * const *)b;
+
+  if (b1->blk == b2->blk)
+    return 0;
+  return b1->blk < b2->blk ? -1 : 1;
+}
+
+int dcache_flush(struct disk_cache *dc)
+{
+  struct dc_block **dirty;
+  struct iovec iov[DC_MAX_FILL];
+  int i, j, n = 0, err = 0;
+
+  dirty = malloc(dc->nblocks * sizeof(*dirty));
+  assert(dirty);
+  for (i = 0; i < dc->nblocks; i++) {
+    if (dc->blocks[i].dirty)
+      dirty[n++] = &dc->blocks[i];
+  }
+  qsort(dirty, n, sizeof(*dirty), blk_cmp);
+
+  /* coalesce runs of adjacent full blocks into one write */
+  for (i = 0; i < n; i = j) {
+    ssize_t len = 0, ret;
+
+    for (j = i; j < n && j - i < DC_MAX_FILL; j++) {
+      if (j > i && (dirty[j]->blk != dirty[j - 1]->blk + 1 ||
+          dirty[j - 1]->valid != DCACHE_BLK_SIZE))
+        break;
+      iov[j - i].iov_base = dirty[j]->data;
+      iov[j - i].iov_len = dirty[j]->valid;
+      len += dirty[j]->valid;
+    }
+    ret = dc->wr(dc->arg, iov, j - i, dirty[i]->blk << DCACHE_BLK_SHIFT);
+    dc->st.pwrites++;
+    if (ret != len) {
+      /* keep the rest dirty for the next flush */
+      dc->wr_err = ret < 0 ? errno : EIO;
+      error("DISK: cache flush failed: %s\n", strerror(dc->wr_err));
+      err = -1;
+      break;
+    }
+    dc->st.writebacks += j - i;
+    while (i < j)
+      dirty[i++]->dirty = 0;
+  }
+  free(dirty);
+  if (!err)
+    dc->wr_err = 0;
+  return err;
+}
+
+struct disk_cache *dcache_create(dcache_io_t rd, dcache_io_t wr, void *arg,
+    int nblocks, int writeback)
+{
+  struct disk_cache *dc;
+  unsigned hsize;
+  int i;
+
+  if (nblocks < 2 * DC_RA_MIN)
+    return NULL;
+  dc = calloc(1, sizeof(*dc));
+  assert(dc);
+  for (hsize = 1; hsize < nblocks; hsize <<= 1);
+  dc->rd = rd;
+  dc->wr = wr;
+  dc->arg = arg;
+  dc->wb = writeback;
+  dc->nblocks = nblocks;
+  dc->hmask = hsize - 1;
+  dc->hash = calloc(hsize, sizeof(*dc->hash));
+  dc->blocks = calloc(nblocks, sizeof(*dc->blocks));
+  dc->mem = malloc((size_t)nblocks * DCACHE_BLK_SIZE);
+  assert(dc->hash && dc->blocks && dc->mem);
+  dc->lru.next = dc->lru.prev = &dc->lru;
+  for (i = 0; i < nblocks; i++) {
+    struct dc_block *b = &dc->blocks[i];
+    b->blk = DC_NO_BLK;
+    b->data = dc->mem + (size_t)i * DCACHE_BLK_SIZE;
+    lru_push_back(dc, b);
+  }
+  dc->next_blk = DC_NO_BLK;
+  return dc;
+}
+
+void dcache_destroy(struct disk_cache *dc)
+{
+  if (dcache_flush(dc))
+    error("DISK: dirty cache blocks lost\n");
+  free(dc->mem);
+  free(dc->blocks);
+  free(dc->hash);
+  free(dc);
+}
+
+void dcache_get_stats(const struct disk_cache *dc, struct dcache_stats *st)
+{
+  *st = dc->st;
+}
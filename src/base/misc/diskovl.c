@@ -0,0 +1,457 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: copy-on-write overlay for disk images.
+ *
+ * Many instances can share one base image which is only ever read, so
+ * it stays in the host page cache once. Every instance writes into its
+ * own sparse delta file that has the same layout as the base, shifted
+ * by the delta header. A bitmap with one bit per 512-byte unit tells
+ * which units live in the delta.
+ *
+ * Delta file layout:
+ *   0                 struct ovl_header
+ *   OVL_BITMAP_OFF    bitmap
+ *   data_off          data, unit N at data_off + N * OVL_UNIT
+ *
+ * Modes: KEEP preserves the delta across runs, DISCARD drops it on exit
+ * and COMMIT writes it back into the base image on exit. A kept delta
+ * records the identity of its base (inode, size, mtime) and is refused
+ * if the base was replaced or modified since.
+ *
+ * A named delta file is held with an exclusive flock() for as long as
+ * it is open, so a second instance pointed at it fails instead of
+ * sharing it. A COMMIT delta that is still there when the overlay is
+ * opened was left by a run that did not exit cleanly; it is loaded
+ * like a kept one and committed on this exit. A COMMIT delta in an
+ * unlinked temporary file is lost if dosemu crashes.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "dosemu_debug.h"
+#include "diskovl.h"
+
+#define OVL_MAGIC	"DOSEMUOVL"
+#define OVL_VERSION	2
+#define OVL_UNIT_SHIFT	9
+#define OVL_UNIT	(1 << OVL_UNIT_SHIFT)
+#define OVL_BITMAP_OFF	OVL_UNIT
+#define OVL_DATA_ALIGN	4096
+
+struct ovl_header {
+  char magic[10];
+  uint16_t version;
+  uint32_t unit;
+  uint64_t base_size;
+  uint64_t data_off;
+  uint64_t base_dev;
+  uint64_t base_ino;
+  int64_t base_mtime_sec;
+  uint32_t base_mtime_nsec;
+} __attribute__((packed));
+
+struct disk_overlay {
+  int fd;
+  int base_fd;
+  int mode;
+  struct stat base_st;
+  off_t base_size;
+  off_t data_off;
+  uint64_t nunits;
+  unsigned char *bitmap;
+  size_t bm_size;
+  size_t bm_dirty_lo, bm_dirty_hi;	/* dirty byte range of bitmap */
+};
+
+static int unit_present(const struct disk_overlay *ov, uint64_t u)
+{
+  if (u >= ov->nunits)
+    return 0;
+  return (ov->bitmap[u >> 3] >> (u & 7)) & 1;
+}
+
+static void unit_set(struct disk_overlay *ov, uint64_t u)
+{
+  size_t idx = u >> 3;
+
+  ov->bitmap[idx] |= 1 << (u & 7);
+  if (idx < ov->bm_dirty_lo)
+    ov->bm_dirty_lo = idx;
+  if (idx + 1 > ov->bm_dirty_hi)
+    ov->bm_dirty_hi = idx + 1;
+}
+
+int dovl_parse_mode(const char *s)
+{
+  if (!s[0] || strcmp(s, "off") == 0)
+    return DOVL_NONE;
+  if (strcmp(s, "keep") == 0)
+    return DOVL_KEEP;
+  if (strcmp(s, "discard") == 0)
+    return DOVL_DISCARD;
+  if (strcmp(s, "commit") == 0)
+    return DOVL_COMMIT;
+  return -1;
+}
+
+static int ovl_tmpfile(void)
+{
+  const char *dir = getenv("TMPDIR");
+  char *name;
+  int fd;
+
+  if (!dir)
+    dir = "/tmp";
+  if (asprintf(&name, "%s/dosemu-ovl-XXXXXX", dir) == -1)
+    return -1;
+  fd = mkstemp(name);
+  if (fd != -1)
+    unlink(name);
+  free(name);
+  return fd;
+}
+
+static int ovl_load(struct disk_overlay *ov)
+{
+  struct ovl_header hdr;
+
+  if (pread(ov->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+    return -1;
+  if (memcmp(hdr.magic, OVL_MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.version != OVL_VERSION || hdr.unit != OVL_UNIT) {
+    error("DISK: overlay has bad header\n");
+    return -1;
+  }
+  if (hdr.base_size != ov->base_size || hdr.data_off != ov->data_off) {
+    error("DISK: overlay does not match its base image\n");
+    return -1;
+  }
+  if (hdr.base_dev != ov->base_st.st_dev ||
+      hdr.base_ino != ov->base_st.st_ino ||
+      hdr.base_mtime_sec != ov->base_st.st_mtim.tv_sec ||
+      hdr.base_mtime_nsec != ov->base_st.st_mtim.tv_nsec) {
+    error("DISK: base image was replaced or modified after the overlay "
+        "was created\n");
+    return -1;
+  }
+  if (pread(ov->fd, ov->bitmap, ov->bm_size, OVL_BITMAP_OFF) !=
+      ov->bm_size) {
+    error("DISK: overlay bitmap truncated\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int ovl_init(struct disk_overlay *ov)
+{
+  struct ovl_header hdr = {};
+
+  memcpy(hdr.magic, OVL_MAGIC, sizeof(hdr.magic));
+  hdr.version = OVL_VERSION;
+  hdr.unit = OVL_UNIT;
+  hdr.base_size = ov->base_size;
+  hdr.data_off = ov->data_off;
+  hdr.base_dev = ov->base_st.st_dev;
+  hdr.base_ino = ov->base_st.st_ino;
+  hdr.base_mtime_sec = ov->base_st.st_mtim.tv_sec;
+  hdr.base_mtime_nsec = ov->base_st.st_mtim.tv_nsec;
+  if (ftruncate(ov->fd, 0) == -1 ||
+      pwrite(ov->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+    return -1;
+  /* the bitmap is written out on the first sync */
+  ov->bm_dirty_lo = 0;
+  ov->bm_dirty_hi = ov->bm_size;
+  return 0;
+}
+
+struct disk_overlay *dovl_open(const char *path, int base_fd, int mode)
+{
+  struct disk_overlay *ov;
+  struct stat st;
+  int existing = 0;
+
+  if (fstat(base_fd, &st) == -1)
+    return NULL;
+  ov = calloc(1, sizeof(*ov));
+  assert(ov);
+  ov->base_fd = dup(base_fd);
+  if (ov->base_fd == -1) {
+    error("DISK: can't dup base image fd: %s\n", strerror(errno));
+    free(ov);
+    return NULL;
+  }
+  ov->mode = mode;
+  ov->base_st = st;
+  ov->base_size = st.st_size;
+  ov->nunits = (st.st_size + OVL_UNIT - 1) >> OVL_UNIT_SHIFT;
+  ov->bm_size = (ov->nunits + 7) >> 3;
+  ov->data_off = (OVL_BITMAP_OFF + ov->bm_size + OVL_DATA_ALIGN - 1) &
+      ~(OVL_DATA_ALIGN - 1);
+  ov->bitmap = calloc(1, ov->bm_size);
+  assert(ov->bitmap);
+  ov->bm_dirty_lo = ov->bm_size;
+
+  if (path) {
+    /* no O_TRUNC: the file may belong to another instance */
+    ov->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  } else {
+    ov->fd = ovl_tmpfile();
+  }
+  if (ov->fd == -1) {
+    error("DISK: can't open overlay %s: %s\n", path ?: "(tmp)",
+        strerror(errno));
+    goto err;
+  }
+  if (path && flock(ov->fd, LOCK_EX | LOCK_NB) == -1) {
+    if (errno == EWOULDBLOCK)
+      error("DISK: overlay %s is in use by another dosemu\n", path);
+    else
+      error("DISK: can't lock overlay %s: %s\n", path, strerror(errno));
+    close(ov->fd);
+    goto err;
+  }
+  if (path && mode == DOVL_DISCARD) {
+    /* nothing to keep, and this way it is gone even after a crash */
+    unlink(path);
+  } else if (path && fstat(ov->fd, &st) == 0 && st.st_size) {
+    existing = 1;
+    if (mode == DOVL_COMMIT)
+      warn("DISK: overlay %s was not committed, committing it on exit\n",
+          path);
+  }
+  if (existing ? ovl_load(ov) : ovl_init(ov)) {
+    close(ov->fd);
+    goto err;
+  }
+
+  d_printf("DISK: %s overlay %s on %lld byte base\n",
+      existing ? "reusing" : "created", path ?: "(tmp)",
+      (long long)ov->base_size);
+  return ov;
+
+err:
+  close(ov->base_fd);
+  free(ov->bitmap);
+  free(ov);
+  return NULL;
+}
+
+ssize_t dovl_pread(struct disk_overlay *ov, void *buf, size_t len, off_t pos)
+{
+  unsigned char *p = buf;
+  size_t done = 0;
+
+  while (done < len) {
+    uint64_t u = pos >> OVL_UNIT_SHIFT;
+    int in = unit_present(ov, u);
+    off_t end = pos + (len - done);
+    off_t run_end = (off_t)(u + 1) << OVL_UNIT_SHIFT;
+    ssize_t n, ret;
+
+    /* one pread() for every run of units on the same side */
+    while (run_end < end && unit_present(ov, run_end >> OVL_UNIT_SHIFT) == in)
+      run_end += OVL_UNIT;
+    if (run_end > end)
+      run_end = end;
+    n = run_end - pos;
+    if (in)
+      ret = pread(ov->fd, p + done, n, ov->data_off + pos);
+    else
+      ret = pread(ov->base_fd, p + done, n, pos);
+    if (ret == -1)
+      return done ? done : -1;
+    done += ret;
+    pos += ret;
+    if (ret < n)
+      break;
+  }
+  return done;
+}
+
+static int ovl_fill_unit(struct disk_overlay *ov, uint64_t u,
+    unsigned char *buf)
+{
+  ssize_t ret = pread(ov->base_fd, buf, OVL_UNIT, u << OVL_UNIT_SHIFT);
+
+  if (ret == -1)
+    return -1;
+  memset(buf + ret, 0, OVL_UNIT - ret);
+  return 0;
+}
+
+ssize_t dovl_pwrite(struct disk_overlay *ov, const void *buf, size_t len,
+    off_t pos)
+{
+  const unsigned char *p = buf;
+  size_t done = 0;
+
+  if (pos + len > ov->nunits << OVL_UNIT_SHIFT) {
+    errno = ENOSPC;
+    return -1;
+  }
+  while (done < len) {
+    uint64_t u = pos >> OVL_UNIT_SHIFT;
+    int off = pos & (OVL_UNIT - 1);
+    size_t n = OVL_UNIT - off;
+    ssize_t ret;
+
+    if (n > len - done)
+      n = len - done;
+    if (n < OVL_UNIT && !unit_present(ov, u)) {
+      /* partial write to a unit still in the base: copy it up first */
+      unsigned char tmp[OVL_UNIT];
+
+      if (ovl_fill_unit(ov, u, tmp) == -1)
+        return done ? done : -1;
+      memcpy(tmp + off, p + done, n);
+      ret = pwrite(ov->fd, tmp, OVL_UNIT,
+          ov->data_off + ((off_t)u << OVL_UNIT_SHIFT));
+      if (ret != OVL_UNIT)
+        return done ? done : -1;
+    } else {
+      /* whole units or a unit already in the delta: write straight through */
+      if (!off && n == OVL_UNIT)
+        n = (len - done) & ~(size_t)(OVL_UNIT - 1);
+      ret = pwrite(ov->fd, p + done, n, ov->data_off + pos);
+      if (ret != n)
+        return done ? done : -1;
+    }
+    for (; u <= (pos + n - 1) >> OVL_UNIT_SHIFT; u++)
+      unit_set(ov, u);
+    done += n;
+    pos += n;
+  }
+  return done;
+}
+
+ssize_t dovl_preadv(void *arg, const struct iovec *iov, int iovcnt, off_t pos)
+{
+  ssize_t done = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; i++) {
+    ssize_t ret = dovl_pread(arg, iov[i].iov_base, iov[i].iov_len, pos);
+
+    if (ret == -1)
+      return done ? done : -1;
+    done += ret;
+    pos += ret;
+    if (ret < iov[i].iov_len)
+      break;
+  }
+  return done;
+}
+
+ssize_t dovl_pwritev(void *arg, const struct iovec *iov, int iovcnt,
+    off_t pos)
+{
+  ssize_t done = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; i++) {
+    ssize_t ret = dovl_pwrite(arg, iov[i].iov_base, iov[i].iov_len, pos);
+
+    if (ret == -1)
+      return done ? done : -1;
+    done += ret;
+    pos += ret;
+    if (ret < iov[i].iov_len)
+      break;
+  }
+  return done;
+}
+
+int dovl_sync(struct disk_overlay *ov)
+{
+  size_t lo = ov->bm_dirty_lo, hi = ov->bm_dirty_hi;
+
+  if (lo >= hi)
+    return 0;
+  ov->bm_dirty_lo = ov->bm_size;
+  ov->bm_dirty_hi = 0;
+  if (pwrite(ov->fd, ov->bitmap + lo, hi - lo, OVL_BITMAP_OFF + lo) !=
+      hi - lo) {
+    error("DISK: overlay bitmap write failed: %s\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+/* copy all runs of units present in the delta back into the base */
+static int ovl_commit(struct disk_overlay *ov)
+{
+  unsigned char buf[64 * OVL_UNIT];
+  uint64_t u = 0;
+  int err = 0;
+
+  if ((fcntl(ov->base_fd, F_GETFL) & O_ACCMODE) == O_RDONLY) {
+    error("DISK: base image is read-only, overlay not committed\n");
+    return -1;
+  }
+  while (u < ov->nunits) {
+    uint64_t cnt = 0;
+    off_t pos = u << OVL_UNIT_SHIFT;
+    ssize_t len;
+
+    if (!unit_present(ov, u)) {
+      u++;
+      continue;
+    }
+    while (u + cnt < ov->nunits && cnt < sizeof(buf) / OVL_UNIT &&
+        unit_present(ov, u + cnt))
+      cnt++;
+    len = cnt << OVL_UNIT_SHIFT;
+    if (pos + len > ov->base_size)
+      len = ov->base_size - pos;
+    if (pread(ov->fd, buf, len, ov->data_off + pos) != len ||
+        pwrite(ov->base_fd, buf, len, pos) != len)
+      err = -1;
+    u += cnt;
+  }
+  if (err)
+    error("DISK: overlay commit failed: %s\n", strerror(errno));
+  else
+    d_printf("DISK: overlay committed to base image\n");
+  return err;
+}
+
+void dovl_close(struct disk_overlay *ov)
+{
+  switch (ov->mode) {
+  case DOVL_KEEP:
+    dovl_sync(ov);
+    break;
+  case DOVL_COMMIT:
+    /* empty, so that the next run does not take it for a leftover */
+    if (ovl_commit(ov) == 0 && ftruncate(ov->fd, 0) == -1)
+      error("DISK: can't truncate committed overlay: %s\n", strerror(errno));
+    break;
+  }
+  close(ov->fd);
+  close(ov->base_fd);
+  free(ov->bitmap);
+  free(ov);
+}
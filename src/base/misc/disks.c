@@ -20,6 +20,7 @@
 #endif
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <inttypes.h>
 
 #include "int.h"
@@ -35,6 +36,9 @@
 #include "dos2linux.h"
 #include "redirect.h"
 #include "cpu-emu.h"
+#include "diskcache.h"
+#include "diskovl.h"
+#include "coio.h"
 
 static int disks_initiated = 0;
 struct disk disktab[MAX_FDISKS];
@@ -44,6 +48,7 @@ struct disk hdisktab[MAX_HDISKS];
 #define HDISKS config.hdisks
 
 static void set_part_ent(struct disk *dp, unsigned char *tmp_mbr);
+static void disk_cache_sync(void);
 
 #if 1
 #  define FLUSHDISK(dp) flush_disk(dp)
@@ -194,6 +199,160 @@ int read_mbr(const struct disk *dp, unsigned buffer)
  * combination.
  */
 
+/* backing store accessors for the block cache */
+static ssize_t disk_fd_preadv(void *arg, const struct iovec *iov, int iovcnt,
+    off_t pos)
+{
+  struct disk *dp = arg;
+  return RPT_SYSCALL(preadv(dp->fdesc, iov, iovcnt, pos));
+}
+
+static ssize_t disk_fd_pwritev(void *arg, const struct iovec *iov, int iovcnt,
+    off_t pos)
+{
+  struct disk *dp = arg;
+  return RPT_SYSCALL(pwritev(dp->fdesc, iov, iovcnt, pos));
+}
+
+/* read from the backing store (image or its overlay), bypassing the cache */
+static ssize_t disk_host_pread(const struct disk *dp, void *buf, size_t len,
+    off_t pos)
+{
+  if (dp->ovl)
+    return dovl_pread(dp->ovl, buf, len, pos);
+  return RPT_SYSCALL(pread(dp->fdesc, buf, len, pos));
+}
+
+/* host side of a disk transfer, runs in an I/O worker thread */
+struct disk_io {
+  struct disk *dp;
+  int write;
+  int len;
+  off_t pos;
+  int ret;
+  unsigned char buf[];
+};
+
+static void disk_io_thr(void *arg)
+{
+  struct disk_io *io = arg;
+  struct disk *dp = io->dp;
+
+  pthread_mutex_lock(&dp->io_mtx);
+  if (io->write) {
+    if (dp->dcache)
+      io->ret = dcache_pwrite(dp->dcache, io->buf, io->len, io->pos);
+    else if (dp->ovl)
+      io->ret = dovl_pwrite(dp->ovl, io->buf, io->len, io->pos);
+    else
+      io->ret = RPT_SYSCALL(pwrite(dp->fdesc, io->buf, io->len, io->pos));
+  } else {
+    if (dp->dcache)
+      io->ret = dcache_pread(dp->dcache, io->buf, io->len, io->pos);
+    else if (dp->ovl)
+      io->ret = dovl_pread(dp->ovl, io->buf, io->len, io->pos);
+    else
+      io->ret = RPT_SYSCALL(pread(dp->fdesc, io->buf, io->len, io->pos));
+  }
+  pthread_mutex_unlock(&dp->io_mtx);
+}
+
+static void disk_mmap_done(struct disk *dp);
+
+/* whether the [pos, pos+len) range can be served from the mapping */
+static int disk_mmap_ok(struct disk *dp, off_t pos, int len)
+{
+  if (!dp->map)
+    return 0;
+  return pos + len <= dp->map_size;
+}
+
+/* whether the copy from or to the mapping hit a truncated image; the
+ * transfer then fails and the drive goes back to pread()/pwrite() */
+static int disk_mmap_lost(struct disk *dp)
+{
+  if (!dp->map_lost)
+    return 0;
+  error("DISK: image %s was truncated while in use\n", dp->dev_name);
+  disk_mmap_done(dp);
+  return 1;
+}
+
+/* pread()/pwrite() wrappers going through the mapping or the block cache
+ * if enabled. Anything that may hit the host disk is done by an I/O
+ * worker while the DOS side keeps running. */
+static int disk_pread(struct disk *dp, unsigned buffer, int len, off_t pos)
+{
+  struct disk_io *io;
+  int ret;
+
+  if (disk_mmap_ok(dp, pos, len)) {
+    memcpy_2dos(buffer, dp->map + pos, len);
+    if (disk_mmap_lost(dp))
+      return -1;
+    return len;
+  }
+  io = coio_alloc(sizeof(*io) + len);
+  if (!io)
+    return -1;
+  io->dp = dp;
+  io->write = 0;
+  io->len = len;
+  io->pos = pos;
+  coio_run(disk_io_thr, io);
+  ret = io->ret;
+  if (ret > 0)
+    memcpy_2dos(buffer, io->buf, ret);
+  coio_free(io);
+  return ret;
+}
+
+static int disk_pwrite(struct disk *dp, unsigned buffer, int len, off_t pos)
+{
+  struct disk_io *io;
+  int ret;
+
+  if (disk_mmap_ok(dp, pos, len)) {
+    memcpy_2unix(dp->map + pos, buffer, len);
+    if (disk_mmap_lost(dp))
+      return -1;
+    return len;
+  }
+  io = coio_alloc(sizeof(*io) + len);
+  if (!io)
+    return -1;
+  io->dp = dp;
+  io->write = 1;
+  io->len = len;
+  io->pos = pos;
+  memcpy_2unix(io->buf, buffer, len);
+  coio_run(disk_io_thr, io);
+  ret = io->ret;
+  coio_free(io);
+  return ret;
+}
+
+/* read the range the way disk_pread() does and throw the data away */
+static int disk_pverify(struct disk *dp, int len, off_t pos)
+{
+  struct disk_io *io;
+  int ret;
+
+  if (disk_mmap_ok(dp, pos, len))
+    return len;
+  io = coio_alloc(sizeof(*io) + len);
+  if (!io)
+    return -1;
+  io->dp = dp;
+  io->write = 0;
+  io->len = len;
+  io->pos = pos;
+  coio_run(disk_io_thr, io);
+  ret = io->ret;
+  coio_free(io);
+  return ret;
+}
+
 static off_t calc_pos(const struct disk *dp, int64_t sector)
 {
     off_t pos;
@@ -207,7 +366,7 @@ static off_t calc_pos(const struct disk *dp, int64_t sector)
 }
 
 int
-read_sectors(const struct disk *dp, unsigned buffer, uint64_t sector,
+read_sectors(struct disk *dp, unsigned buffer, uint64_t sector,
 	     long count)
 {
   off_t  pos;
@@ -289,11 +448,7 @@ read_sectors(const struct disk *dp, unsigned buffer, uint64_t sector,
     tmpread *= SECTOR_SIZE;
   }
   else {
-    if(pos != lseek(dp->fdesc, pos, SEEK_SET)) {
-      error("Sector not found in read_sector, error = %s!\n", strerror(errno));
-      return -DERR_NOTFOUND;
-    }
-    tmpread = dos_read(dp->fdesc, buffer, count * SECTOR_SIZE - already);
+    tmpread = disk_pread(dp, buffer, count * SECTOR_SIZE - already, pos);
   }
 
   if(tmpread != -1) {
@@ -374,11 +529,11 @@ write_sectors(struct disk *dp, unsigned buffer, uint64_t sector,
     tmpwrite *= SECTOR_SIZE;
   }
   else {
-    if(pos != lseek(dp->fdesc, pos, SEEK_SET)) {
-      error("Sector not found in write_sector!\n");
-      return -DERR_NOTFOUND;
+    tmpwrite = disk_pwrite(dp, buffer, count * SECTOR_SIZE - already, pos);
+    if (tmpwrite == -1) {
+      dbug_printf("disks.c: write failed\n");
+      return -DERR_WRITEFLT;
     }
-    tmpwrite = dos_write(dp->fdesc, buffer, count * SECTOR_SIZE - already);
   }
 
   /* this should make floppies a little safer...I would as soon use the
@@ -829,8 +984,8 @@ static void image_setup(struct disk *dp)
   dp->part_info.number = 1;
   dp->part_info.mbr_size = SECTOR_SIZE;
   dp->part_info.mbr = malloc(dp->part_info.mbr_size);
-  lseek(dp->fdesc, dp->header, SEEK_SET);
-  rd = read(dp->fdesc, dp->part_info.mbr, dp->part_info.mbr_size);
+  rd = disk_host_pread(dp, dp->part_info.mbr, dp->part_info.mbr_size,
+      dp->header);
   if (rd != dp->part_info.mbr_size) {
     error("Can't read MBR from %s\n", dp->dev_name);
     leavedos(35);
@@ -993,6 +1148,136 @@ static void set_part_ent(struct disk *dp, unsigned char *tmp_mbr)
   *((uint32_t *)(p+12)) = length;				/* len sects */
 }
 
+/* map small hdisk images, the page cache then serves as the disk cache.
+ * Removable media are never mapped: they are closed and reopened
+ * around media changes. */
+static void disk_mmap_setup(struct disk *dp)
+{
+  struct stat st;
+  int prot = PROT_READ;
+  void *map;
+
+  if (config.disk_mmap <= 0 || dp->map || dp->ovl || dp->type != IMAGE ||
+      dp->removeable || dp->fdesc == -1)
+    return;
+  if (fstat(dp->fdesc, &st) == -1 || !S_ISREG(st.st_mode) ||
+      st.st_size == 0 || st.st_size > (off_t)config.disk_mmap * 1024)
+    return;
+  if ((fcntl(dp->fdesc, F_GETFL) & O_ACCMODE) == O_RDWR)
+    prot |= PROT_WRITE;
+  map = mmap(NULL, st.st_size, prot, MAP_SHARED, dp->fdesc, 0);
+  if (map == MAP_FAILED) {
+    d_printf("DISK: can't mmap %s: %s\n", dp->dev_name, strerror(errno));
+    return;
+  }
+  dp->map = map;
+  dp->map_size = st.st_size;
+  d_printf("DISK: %s mapped, %zu bytes%s\n", dp->dev_name, dp->map_size,
+	   (prot & PROT_WRITE) ? "" : ", read-only");
+}
+
+static void disk_mmap_done(struct disk *dp)
+{
+  if (!dp->map)
+    return;
+  msync(dp->map, dp->map_size, MS_SYNC);
+  munmap(dp->map, dp->map_size);
+  dp->map = NULL;
+  dp->map_size = 0;
+  dp->map_lost = 0;
+}
+
+/* Called from the SIGBUS handler: a mapped image was truncated behind
+ * our back. Scratch pages are put over the rest of the mapping only to
+ * let the faulting copy run to its end. Its data is not used: the
+ * transfer returns a disk error to the guest, and the drive goes back
+ * to pread() and pwrite(), see disk_mmap_lost(). */
+int disk_mmap_fault(void *addr)
+{
+  unsigned char *p = addr;
+  int i;
+
+  FOR_EACH_HDISK(i, {
+    struct disk *dp = &hdisktab[i];
+    unsigned char *pg;
+
+    if (!dp->map || p < dp->map || p >= dp->map + dp->map_size)
+      continue;
+    pg = (unsigned char *)((uintptr_t)p & PAGE_MASK);
+    if (mmap(pg, dp->map + dp->map_size - pg, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+      return 0;
+    dp->map_lost = 1;
+    return 1;
+  });
+  return 0;
+}
+
+static void disk_cache_setup(struct disk *dp)
+{
+  int nblocks;
+
+  if (config.disk_cache <= 0 || dp->type == DIR_TYPE || dp->fdesc == -1 ||
+      dp->map)
+    return;
+  nblocks = config.disk_cache / (DCACHE_BLK_SIZE / 1024);
+  if (dp->ovl)
+    dp->dcache = dcache_create(dovl_preadv, dovl_pwritev, dp->ovl, nblocks,
+	config.disk_cache_wb);
+  else
+    dp->dcache = dcache_create(disk_fd_preadv, disk_fd_pwritev, dp, nblocks,
+	config.disk_cache_wb);
+  if (dp->dcache)
+    d_printf("DISK: %dK %s cache enabled for %s\n", config.disk_cache,
+	     config.disk_cache_wb ? "write-back" : "write-through",
+	     dp->dev_name);
+}
+
+static void disk_cache_done(struct disk *dp)
+{
+  struct dcache_stats st;
+  uint64_t total;
+
+  if (!dp->dcache)
+    return;
+  dcache_get_stats(dp->dcache, &st);
+  total = st.hits + st.misses;
+  d_printf("DISK: cache for %s: %"PRIu64" hits, %"PRIu64" misses "
+	   "(%"PRIu64"%% hit rate), readahead %"PRIu64"/%"PRIu64" used, "
+	   "%"PRIu64" reads, %"PRIu64" writes, %"PRIu64" blocks written back\n",
+	   dp->dev_name, st.hits, st.misses,
+	   total ? st.hits * 100 / total : 0, st.ra_hits, st.ra_blocks,
+	   st.preads, st.pwrites, st.writebacks);
+  dcache_destroy(dp->dcache);
+  dp->dcache = NULL;
+}
+
+/* the overlay outlives fdesc reopening, it holds its own base descriptor */
+static void disk_overlay_setup(struct disk *dp)
+{
+  char *name = NULL;
+
+  if (dp->ovl || dp->ovl_mode == DOVL_NONE || dp->rdonly)
+    return;
+  /* a COMMIT delta gets a file too, so that a crash does not lose it */
+  if (!dp->ovl_name && dp->ovl_mode != DOVL_DISCARD)
+    asprintf(&name, "%s.ovl", dp->dev_name);
+  dp->ovl = dovl_open(name ?: dp->ovl_name, dp->fdesc, dp->ovl_mode);
+  free(name);
+  if (!dp->ovl) {
+    error("can't set up overlay for %s\n", dp->dev_name);
+    config.exitearly = 1;
+  }
+}
+
+static void disk_overlay_done(struct disk *dp)
+{
+  if (!dp->ovl)
+    return;
+  dovl_close(dp->ovl);
+  dp->ovl = NULL;
+}
+
 void
 disk_close(void)
 {
@@ -1002,15 +1287,38 @@ disk_close(void)
   for (dp = disktab; dp < &disktab[FDISKS]; dp++) {
     if (dp->removeable && dp->fdesc >= 0) {
       d_printf("DISK: Closing disk %s\n",dp->dev_name);
+      pthread_mutex_lock(&dp->io_mtx);
       (void) close(dp->fdesc);
       dp->fdesc = -1;
+      pthread_mutex_unlock(&dp->io_mtx);
     }
   }
+  disk_cache_sync();
+}
+
+/* write back the dirty blocks of the hdisk caches and overlay bitmaps,
+ * mapped images are left to the kernel until disk_sync() */
+static void disk_cache_sync(void)
+{
+  int i;
+
+  if (!disks_initiated) return;
+  FOR_EACH_HDISK(i, {
+    /* skip disks busy in an I/O worker, they will be synced next time */
+    if (pthread_mutex_trylock(&hdisktab[i].io_mtx) != 0)
+      continue;
+    if (hdisktab[i].dcache)
+      dcache_flush(hdisktab[i].dcache);
+    if (hdisktab[i].ovl)
+      dovl_sync(hdisktab[i].ovl);
+    pthread_mutex_unlock(&hdisktab[i].io_mtx);
+  });
 }
 
 static void disk_sync(void)
 {
   struct disk *dp;
+  int i;
 
   if (!disks_initiated) return;  /* just to be safe */
   for (dp = disktab; dp < &disktab[FDISKS]; dp++) {
@@ -1019,6 +1327,11 @@ static void disk_sync(void)
       (void) fsync(dp->fdesc);
     }
   }
+  FOR_EACH_HDISK(i, {
+    if (hdisktab[i].map)
+      msync(hdisktab[i].map, hdisktab[i].map_size, MS_SYNC);
+  });
+  disk_cache_sync();
 }
 
 
@@ -1108,17 +1421,24 @@ disk_close_all(void)
   for (dp = disktab; dp < &disktab[FDISKS]; dp++) {
     if (dp->fdesc >= 0) {
       d_printf("Floppy disk Closing %x\n", dp->fdesc);
+      pthread_mutex_lock(&dp->io_mtx);
       (void) close(dp->fdesc);
       dp->fdesc = -1;
+      pthread_mutex_unlock(&dp->io_mtx);
     }
   }
   FOR_EACH_HDISK(i, {
     if(hdisktab[i].type == DIR_TYPE) fatfs_done(&hdisktab[i]);
+    pthread_mutex_lock(&hdisktab[i].io_mtx);
+    disk_cache_done(&hdisktab[i]);
+    disk_overlay_done(&hdisktab[i]);
+    disk_mmap_done(&hdisktab[i]);
     if (hdisktab[i].fdesc >= 0) {
       d_printf("Hard disk Closing %x\n", hdisktab[i].fdesc);
       (void) close(hdisktab[i].fdesc);
       hdisktab[i].fdesc = -1;
     }
+    pthread_mutex_unlock(&hdisktab[i].io_mtx);
   });
   disks_initiated = 0;
 }
@@ -1177,6 +1497,7 @@ disk_init(void)
   for (i = 0; i < MAX_FDISKS; i++) {
     dp = &disktab[i];
     dp->fdesc = -1;
+    pthread_mutex_init(&dp->io_mtx, NULL);
     dp->floppy = 1;
     dp->removeable = 1;
     dp->serial = 0xF10031A0 + dp->drive_num;	// sernum must be unique!
@@ -1185,6 +1506,7 @@ disk_init(void)
   for (i = 0; i < MAX_HDISKS; i++) {
     dp = &hdisktab[i];
     dp->fdesc = -1;
+    pthread_mutex_init(&dp->io_mtx, NULL);
     dp->floppy = 0;
     dp->serial = 0x4ADD1B0A + dp->drive_num;	// sernum must be unique!
   }
@@ -1218,9 +1540,11 @@ static void disk_reset2(void)
     } else if (S_ISBLK(stbuf.st_mode)) {
       d_printf("dev %s: %#x\n", dp->dev_name, (unsigned) stbuf.st_rdev);
       dp->type = FLOPPY;
+      pthread_mutex_lock(&dp->io_mtx);
       if (dp->fdesc != -1)
         close(dp->fdesc);
       dp->fdesc = -1;
+      pthread_mutex_unlock(&dp->io_mtx);
 #ifdef __linux__
       if ((stbuf.st_rdev & 0xff00) == 0x200) {
         d_printf("DISK %s removable\n", dp->dev_name);
@@ -1245,9 +1569,15 @@ static void disk_reset2(void)
    */
   FOR_EACH_HDISK(i, {
     dp = &hdisktab[i];
+    pthread_mutex_lock(&dp->io_mtx);
+    disk_cache_done(dp);
+    disk_mmap_done(dp);
     if (dp->fdesc != -1)
       close(dp->fdesc);
-    dp->fdesc = open(dp->type == DIR_TYPE ? "/dev/null" : dp->dev_name, dp->rdonly ? O_RDONLY : O_RDWR);
+    /* with an overlay only commit mode ever writes to the base image */
+    dp->fdesc = open(dp->type == DIR_TYPE ? "/dev/null" : dp->dev_name,
+        (dp->rdonly || (dp->ovl_mode != DOVL_NONE &&
+        dp->ovl_mode != DOVL_COMMIT)) ? O_RDONLY : O_RDWR);
     if (dp->fdesc < 0) {
       if (errno == EROFS || errno == EACCES) {
         dp->fdesc = open(dp->dev_name, O_RDONLY);
@@ -1265,6 +1595,8 @@ static void disk_reset2(void)
     }
     else dp->rdonly = dp->wantrdonly;
     dp->removeable = 0;
+    if (dp->fdesc >= 0)
+      disk_overlay_setup(dp);
 
     /* HACK: if unspecified geometry (-1) then try to get it from kernel.
        May only work on WD compatible disks (MFM/RLL/ESDI/IDE). */
@@ -1275,6 +1607,9 @@ static void disk_reset2(void)
      * (mostly for the partition type)
      */
     disk_fptrs[dp->type].setup(dp);
+    disk_mmap_setup(dp);
+    disk_cache_setup(dp);
+    pthread_mutex_unlock(&dp->io_mtx);
 
     /* this really doesn't make sense...where the disk geometry
      * is in reality given for the actual disk (i.e. /dev/hda)
@@ -1365,6 +1700,11 @@ static void hdisk_reset(int num)
     HDISKS = num;
   FOR_EACH_HDISK(i, {
     if (HDISK_NUM(i) >= num + 2) {
+      pthread_mutex_lock(&hdisktab[i].io_mtx);
+      disk_cache_done(&hdisktab[i]);
+      disk_overlay_done(&hdisktab[i]);
+      disk_mmap_done(&hdisktab[i]);
+      pthread_mutex_unlock(&hdisktab[i].io_mtx);
       hdisktab[i].drive_num = 0;
       continue;
     }
@@ -1483,6 +1823,7 @@ int int13(void)
   switch (HI(ax)) {
   case 0:			/* init */
     d_printf("DISK %02x init\n", disk);
+    disk_cache_sync();
     HI(ax) = DERR_NOERR;
     NOCARRY;
     break;
@@ -1670,22 +2011,32 @@ int int13(void)
       break;
     }
 
-    if (pos != lseek(dp->fdesc, pos, 0)) {
+    if (dp->type == DIR_TYPE && dp->fatfs) {
+      REG(eflags) &= ~CF;
+      break;
+    }
+    if (number > I13_MAX_ACCESS) {
+      HI(ax) = DERR_BOUNDARY;
+      REG(eflags) |= CF;
+      error("test: too large verify %d\n", number);
+      break;
+    }
+
+    /* read through the cache and the overlay, like a read would */
+    res = disk_pverify(dp, number << 9, pos);
+    if (res < 0) {
       HI(ax) = DERR_NOTFOUND;
       REG(eflags) |= CF;
       error("test: sector not found 6\n");
       break;
     }
-#if 0
-    res = lseek(dp->fdesc, number << 9, 0);
-    if (res & 0x1ff) {		/* must read multiple of 512 bytes  and res != -1 */
+    if (res & 0x1ff) {		/* must read multiple of 512 bytes */
       HI(ax) = DERR_BADSEC;
       REG(eflags) |= CF;
       error("test: sector corrupt 3\n");
       break;
     }
     LWORD(eax) = res >> 9;
-#endif
     REG(eflags) &= ~CF;
     break;
 
@@ -2151,7 +2502,7 @@ int int13(void)
   return 1;
 }
 
-/* flush disks every config.fastfloppy ticks */
+/* flush disks and hdisk caches every config.fastfloppy ticks */
 void
 floppy_tick(void)
 {
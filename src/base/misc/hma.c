@@ -13,6 +13,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "memory.h"
 #include "emu.h"
 #include "hma.h"
@@ -79,6 +82,7 @@ void HMA_init(void)
     ext_mem_base = mmap_mapping(MAPPING_EXTMEM | MAPPING_SCRATCH, -1,
       EXTMEM_SIZE, PROT_READ | PROT_WRITE);
     x_printf("Ext.Mem of size 0x%x at %p\n", EXTMEM_SIZE, ext_mem_base);
+    mapping_huge_coverage("extended memory", ext_mem_base, EXTMEM_SIZE);
     memcheck_addtype('x', "Extended memory (HMA+XMS)");
     memcheck_reserve('x', LOWMEM_SIZE, HMASIZE + EXTMEM_SIZE);
   }
@@ -90,6 +94,57 @@ hma_exit(void)
 {
 }
 
+/* Stores to extended memory bypass the cache: a disk cache or a RAM
+   disk won't read the block back any time soon, while DOS reads what
+   is copied to conventional memory right away. */
+#define NT_COPY_MIN 1024
+
+static void extmem_store(unsigned char *d, const unsigned char *s, size_t len)
+{
+#ifdef __SSE2__
+  if (len >= NT_COPY_MIN && (d + len <= s || s + len <= d)) {
+    size_t head = -(uintptr_t)d & 15;
+
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+    for (; len >= 64; d += 64, s += 64, len -= 64) {
+      __m128i a = _mm_loadu_si128((const __m128i *)s);
+      __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+      __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+      __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+      _mm_stream_si128((__m128i *)d, a);
+      _mm_stream_si128((__m128i *)(d + 16), b);
+      _mm_stream_si128((__m128i *)(d + 32), c);
+      _mm_stream_si128((__m128i *)(d + 48), e);
+    }
+    _mm_sfence();
+    memcpy(d, s, len);
+    return;
+  }
+#endif
+  memmove(d, s, len);
+}
+
+/* conventional memory may be non-contiguous because of EMS, and
+   the VGA window may be emulated, so that side goes page by page */
+static void copy_to_extmem(unsigned char *pd, unsigned s, unsigned len)
+{
+  if (s < 0xc0000 && s + len > 0xa0000) {
+    memcpy_2unix(pd, s, len);
+    return;
+  }
+  while (len) {
+    unsigned bound = (s & PAGE_MASK) + PAGE_SIZE;
+    unsigned n = min(len, bound - s);
+    extmem_store(pd, dosaddr_to_unixaddr(s), n);
+    pd += n;
+    s += n;
+    len -= n;
+  }
+}
+
 void extmem_copy(unsigned dst, unsigned src, unsigned len)
 {
   unsigned slen, dlen, clen, copied = 0;
@@ -112,18 +167,18 @@ void extmem_copy(unsigned dst, unsigned src, unsigned len)
     clen = min(slen, dlen);
     x_printf("INT15: copy 0x%x bytes from %#x to %#x%s\n",
       clen, s, d, clen != len ? " (split)" : "");
+    /* the helpers invalidate only the destination range for the JIT */
     if (d < edge) {
       if (s < edge)
 	memmove_dos2dos(d, s, clen);
       else
 	memcpy_2dos(d, ps, clen);
-      e_invalidate(d, clen);
     } else {
       unsigned char *pd = &ext_mem_base[d - edge];
       if (s < edge)
-	memcpy_2unix(pd, s, clen);
+	copy_to_extmem(pd, s, clen);
       else
-	memmove(pd, ps, clen);
+	extmem_store(pd, ps, clen);
     }
     copied += clen;
   }
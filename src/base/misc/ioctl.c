@@ -38,6 +38,7 @@
 #include "bitops.h"
 #include "pic.h"
 #include "dpmi.h"
+#include "deadline.h"
 
 #ifdef USE_MHPDBG
   #include "mhpdbg.h"
@@ -127,6 +128,7 @@ io_select(void)
 	}
       }
       reset_idle(0);
+      deadline_kick();
       break;
     }
 }
@@ -29,6 +29,7 @@
 #include "dos2linux.h"
 #include "dosemu_config.h"
 #include "mhpdbg.h"
+#include "deadline.h"
 
 /*
  * NOTE: SHOW_TIME _only_ should be enabled for
@@ -666,7 +667,6 @@ void call_cmd(const char *cmd, int maxargs, const struct cmd_db *cmdtab,
 
 void sigalarm_onoff(int on)
 {
-  static struct itimerval itv_old;
 #ifdef X86_EMULATOR
   static struct itimerval itv_oldp;
 #endif
@@ -674,7 +674,7 @@ void sigalarm_onoff(int on)
   static volatile int is_off = 0;
   if (on) {
     if (is_off--) {
-	setitimer(ITIMER_REAL, &itv_old, NULL);
+	deadline_block(0);
 #ifdef X86_EMULATOR
 	setitimer(ITIMER_VIRTUAL, &itv_oldp, NULL);
 #endif
@@ -683,7 +683,7 @@ void sigalarm_onoff(int on)
   else if (!is_off++) {
     itv.it_interval.tv_sec = itv.it_interval.tv_usec = 0;
     itv.it_value = itv.it_interval;
-    setitimer(ITIMER_REAL, &itv, &itv_old);
+    deadline_block(1);
 #ifdef X86_EMULATOR
     setitimer(ITIMER_VIRTUAL, &itv, &itv_oldp);
 #endif
@@ -958,12 +958,11 @@ static void pcm_get_samples(double time,
     }
 }
 
-static void pcm_mix_samples(sndbuf_t in[][SNDBUF_CHANS],
-	sndbuf_t out[SNDBUF_CHANS], int channels, int format,
+static void pcm_mix_value(sndbuf_t in[][SNDBUF_CHANS],
+	int value[SNDBUF_CHANS], int channels,
 	double volume[][SNDBUF_CHANS][SNDBUF_CHANS])
 {
     int i, j, k;
-    int value[SNDBUF_CHANS] = { 0 };
 
     for (j = 0; j < SNDBUF_CHANS; j++) {
 	for (i = 0; i < pcm.num_streams; i++) {
@@ -978,12 +977,60 @@ static void pcm_mix_samples(sndbuf_t in[][SNDBUF_CHANS],
     }
     for (i = channels; i < SNDBUF_CHANS; i++)
 	value[0] += value[i];
+}
+
+static void pcm_mix_samples(sndbuf_t in[][SNDBUF_CHANS],
+	sndbuf_t out[SNDBUF_CHANS], int channels, int format,
+	double volume[][SNDBUF_CHANS][SNDBUF_CHANS])
+{
+    int i;
+    int value[SNDBUF_CHANS] = { 0 };
+
+    pcm_mix_value(in, value, channels, volume);
     for (i = 0; i < channels; i++) {
 	S16_to_sample(pcm_samp_cutoff(value[i], PCM_FORMAT_S16_LE),
 		&out[i], format);
     }
 }
 
+/* same as above, but to a planar float block for the effect processors.
+ * Clipping is left to pcm_float_to_samples(), after the effects. */
+static void pcm_mix_samples_f(sndbuf_t in[][SNDBUF_CHANS],
+	float *out[SNDBUF_CHANS], int idx, int channels,
+	double volume[][SNDBUF_CHANS][SNDBUF_CHANS])
+{
+    int i;
+    int value[SNDBUF_CHANS] = { 0 };
+
+    pcm_mix_value(in, value, channels, volume);
+    for (i = 0; i < channels; i++)
+	out[i][idx] = value[i] * (1.0f / 32768);
+}
+
+static void pcm_float_to_samples(float *in[SNDBUF_CHANS],
+	sndbuf_t out[][SNDBUF_CHANS], int nframes, int channels, int format)
+{
+    int i, j;
+
+    for (i = 0; i < channels; i++) {
+	const float *src = in[i];
+
+	if (format == PCM_FORMAT_S16_LE) {
+	    for (j = 0; j < nframes; j++) {
+		float v = src[j] * 32768;
+		out[j][i] = v >= SHRT_MAX ? SHRT_MAX : v <= SHRT_MIN ?
+			SHRT_MIN : lrintf(v);
+	    }
+	    continue;
+	}
+	for (j = 0; j < nframes; j++) {
+	    float v = src[j] * 32768;
+	    S16_to_sample(v >= SHRT_MAX ? SHRT_MAX : v <= SHRT_MIN ?
+		    SHRT_MIN : lrintf(v), &out[j][i], format);
+	}
+    }
+}
+
 static void calc_idxs(struct pcm_player_wr *pl, int idxs[MAX_STREAMS])
 {
     int i;
@@ -1037,7 +1084,7 @@ static void get_volumes(int id, double volume[][SNDBUF_CHANS][SNDBUF_CHANS])
 int pcm_data_get_interleaved(sndbuf_t buf[][SNDBUF_CHANS], int nframes,
 			   struct player_params *params)
 {
-    int idxs[MAX_STREAMS], out_idx, handle, i;
+    int idxs[MAX_STREAMS], out_idx, handle, i, num_efps;
     long long now;
     double start_time, stop_time, frame_period, frag_period, time;
     sndbuf_t samp[MAX_STREAMS][SNDBUF_CHANS];
@@ -1080,6 +1127,14 @@ int pcm_data_get_interleaved(sndbuf_t buf[][SNDBUF_CHANS], int nframes,
 	 nframes, p->plugin->name, start_time,
 	 stop_time, now - start_time);
 
+    num_efps = PL_PRIV(p)->num_efp_links;
+    /* +1 so that the VLA is never empty */
+    float fdata[SNDBUF_CHANS][num_efps ? nframes + 1 : 1];
+    float *fbuf[SNDBUF_CHANS];
+
+    for (i = 0; i < SNDBUF_CHANS; i++)
+	fbuf[i] = fdata[i];
+
     pthread_mutex_lock(&pcm.strm_mtx);
     if (!p->opened) {
 	pcm_printf("PCM: player %s already closed\n",
@@ -1093,8 +1148,11 @@ int pcm_data_get_interleaved(sndbuf_t buf[][SNDBUF_CHANS], int nframes,
     get_volumes(PLAYER(p)->id, volume);
     for (out_idx = 0; out_idx < nframes; out_idx++) {
 	pcm_get_samples(time, samp, idxs, params->channels, PLAYER(p)->id);
-	pcm_mix_samples(samp, buf[out_idx], params->channels, params->format,
-		volume);
+	if (num_efps)
+	    pcm_mix_samples_f(samp, fbuf, out_idx, params->channels, volume);
+	else
+	    pcm_mix_samples(samp, buf[out_idx], params->channels,
+		    params->format, volume);
 	time += frame_period;
     }
     if (fabs(time - stop_time) > frame_period)
@@ -1104,11 +1162,15 @@ int pcm_data_get_interleaved(sndbuf_t buf[][SNDBUF_CHANS], int nframes,
     save_idxs(PL_PRIV(p), idxs);
     pthread_mutex_unlock(&pcm.strm_mtx);
 
-    for (i = 0; i < PL_PRIV(p)->num_efp_links; i++) {
+    /* the whole chain runs on the float block, converted only once */
+    for (i = 0; i < num_efps; i++) {
 	struct efp_link *l = &PL_PRIV(p)->efpl[i];
-	EFPR(l->efp)->process(l->handle, buf, nframes,
-		params->channels, params->format, params->rate);
+	EFPR(l->efp)->process(l->handle, fbuf, out_idx,
+		params->channels, params->rate);
     }
+    if (num_efps)
+	pcm_float_to_samples(fbuf, buf, out_idx, params->channels,
+		params->format);
 
     if (out_idx != nframes)
 	error("PCM: requested=%i prepared=%i\n", nframes, out_idx);
@@ -1214,6 +1276,11 @@ void pcm_reset_player(int handle)
     memset(pl->last_cnt, 0, sizeof(pl->last_cnt));
 }
 
+int pcm_playing(void)
+{
+    return !!pcm.playing;
+}
+
 void pcm_timer(void)
 {
     int i;
@@ -0,0 +1,141 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: one worker thread for all sound generators.
+ *
+ * Adlib, fluidsynth and munt used to have a thread each, all woken by
+ * the same sound timer. Now the timer wakes a single worker that runs
+ * every registered generator against the same deadline. A wakeup that
+ * comes while the worker is still busy is merged with the pending one,
+ * as the next pass renders everything that is due anyway.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include <errno.h>
+#include "emu.h"
+#include "timers.h"
+#include "sound/synth.h"
+
+#define MAX_SYNTHS 8
+
+struct synth_gen {
+    synth_run_t run;
+    void *arg;
+    const char *name;
+};
+
+static struct synth_gen gens[MAX_SYNTHS];
+static int num_gens;
+static pthread_mutex_t gen_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pend_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t syn_thr;
+static sem_t syn_sem;
+static int syn_pending;
+
+static void *synth_thread(void *arg)
+{
+    int i;
+    long long now;
+
+    while (1) {
+	sem_wait(&syn_sem);
+	pthread_mutex_lock(&pend_mtx);
+	syn_pending = 0;
+	pthread_mutex_unlock(&pend_mtx);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	now = GETusTIME(0);
+	pthread_mutex_lock(&gen_mtx);
+	for (i = 0; i < num_gens; i++)
+	    gens[i].run(gens[i].arg, now);
+	pthread_mutex_unlock(&gen_mtx);
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    }
+    return NULL;
+}
+
+int synth_register(synth_run_t run, void *arg, const char *name)
+{
+    int err;
+
+    pthread_mutex_lock(&gen_mtx);
+    if (num_gens >= MAX_SYNTHS) {
+	pthread_mutex_unlock(&gen_mtx);
+	error("SYNTH: too many generators, %s not registered\n", name);
+	return -1;
+    }
+    gens[num_gens].run = run;
+    gens[num_gens].arg = arg;
+    gens[num_gens].name = name;
+    num_gens++;
+    pthread_mutex_unlock(&gen_mtx);
+    S_printf("SYNTH: registered %s\n", name);
+
+    if (num_gens > 1)
+	return 0;
+    sem_init(&syn_sem, 0, 0);
+    err = pthread_create(&syn_thr, NULL, synth_thread, NULL);
+    if (err) {
+	error("SYNTH: can't create thread: %s\n", strerror(err));
+	sem_destroy(&syn_sem);
+	num_gens = 0;
+	return -1;
+    }
+#if defined(HAVE_PTHREAD_SETNAME_NP) && defined(__GLIBC__)
+    pthread_setname_np(syn_thr, "dosemu: synth");
+#endif
+    return 0;
+}
+
+void synth_unregister(synth_run_t run, void *arg)
+{
+    int i;
+
+    pthread_mutex_lock(&gen_mtx);
+    for (i = 0; i < num_gens; i++) {
+	if (gens[i].run == run && gens[i].arg == arg)
+	    break;
+    }
+    if (i == num_gens) {
+	pthread_mutex_unlock(&gen_mtx);
+	return;
+    }
+    S_printf("SYNTH: unregistered %s\n", gens[i].name);
+    memmove(&gens[i], &gens[i + 1], (num_gens - i - 1) * sizeof(gens[0]));
+    num_gens--;
+    pthread_mutex_unlock(&gen_mtx);
+
+    if (num_gens)
+	return;
+    pthread_cancel(syn_thr);
+    pthread_join(syn_thr, NULL);
+    sem_destroy(&syn_sem);
+    syn_pending = 0;
+}
+
+void synth_timer(void)
+{
+    if (!num_gens)
+	return;
+    pthread_mutex_lock(&pend_mtx);
+    if (!syn_pending) {
+	syn_pending = 1;
+	sem_post(&syn_sem);
+    }
+    pthread_mutex_unlock(&pend_mtx);
+}
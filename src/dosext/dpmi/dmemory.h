@@ -9,6 +9,7 @@
 
 typedef struct dpmi_pm_block_stuct {
   struct   dpmi_pm_block_stuct *next;
+  struct   dpmi_pm_block_stuct *hnext;	/* handle hash chain */
   unsigned int handle;
   unsigned int size;
   dosaddr_t base;
@@ -17,10 +18,14 @@ typedef struct dpmi_pm_block_stuct {
   unsigned int shmsize;
   char *shmname;
   char *rshmname;
+  int noidx;		/* overlaps another block, not in the page index */
 } dpmi_pm_block;
 
+#define PM_HASH_SIZE 64
+
 typedef struct dpmi_pm_block_root_struc {
   dpmi_pm_block *first_pm_block;
+  dpmi_pm_block *hash[PM_HASH_SIZE];
 } dpmi_pm_block_root;
 
 dpmi_pm_block *lookup_pm_block(dpmi_pm_block_root *root, unsigned long h);
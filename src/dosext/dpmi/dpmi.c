@@ -212,6 +212,39 @@ void *SEL_ADR_CLNT(unsigned short sel, unsigned int reg, int is_32)
   return SEL_ADR_LDT(sel, reg, is_32);
 }
 
+/* In native mode the kernel's copy of the LDT is only needed while
+ * the client runs. Descriptor writes update ldt_buffer at once, but the
+ * modify_ldt() calls are deferred to ldt_flush(), so that a descriptor
+ * set up by several DPMI calls in a row (allocate, set base, set limit,
+ * set access rights) costs one syscall, and writes that don't change
+ * the descriptor cost none. */
+static struct user_desc ldt_pending[LDT_ENTRIES];
+static uint8_t ldt_dirty[LDT_ENTRIES / 8];
+static int ldt_dirty_lo = LDT_ENTRIES, ldt_dirty_hi = -1;
+
+static void ldt_flush(void)
+{
+  int i;
+
+  for (i = ldt_dirty_lo; i <= ldt_dirty_hi; i++) {
+    struct user_desc *ldt_info = &ldt_pending[i];
+
+    if (!(ldt_dirty[i >> 3] & (1 << (i & 7))))
+      continue;
+    ldt_dirty[i >> 3] &= ~(1 << (i & 7));
+    /* NOTE: the real LDT in kernel space uses the real addresses, but
+       the LDT we emulate, and DOS applications work with,
+       has all base addresses with respect to mem_base */
+    if (ldt_info->base_addr || ldt_info->limit)
+      ldt_info->base_addr += (uintptr_t)mem_base;
+    if (modify_ldt(LDT_WRITE, ldt_info, sizeof(*ldt_info)))
+      error("DPMI: modify_ldt() failed for entry %#x: %s\n", i,
+	  strerror(errno));
+  }
+  ldt_dirty_lo = LDT_ENTRIES;
+  ldt_dirty_hi = -1;
+}
+
 int get_ldt(void *buffer)
 {
 #ifdef __linux__
@@ -219,6 +252,7 @@ int get_ldt(void *buffer)
   struct descriptor *dp;
   if (config.cpu_vm_dpmi != CPUVM_NATIVE)
 	return emu_modify_ldt(0, buffer, LDT_ENTRIES * LDT_ENTRY_SIZE);
+  ldt_flush();
   ret = modify_ldt(0, buffer, LDT_ENTRIES * LDT_ENTRY_SIZE);
   /* do emu_modify_ldt even if modify_ldt fails, so cpu_vm_dpmi fallbacks can
      still work */
@@ -244,6 +278,7 @@ static int set_ldt_entry(int entry, unsigned long base, unsigned int limit,
    * Otherwise, there would be some uninitialized padding bits at the end.
    */
   struct user_desc ldt_info = {};
+  uint8_t old[LDT_ENTRY_SIZE];
 
   int __retval;
   ldt_info.entry_number = entry;
@@ -256,21 +291,9 @@ static int set_ldt_entry(int entry, unsigned long base, unsigned int limit,
   ldt_info.seg_not_present = seg_not_present;
   ldt_info.useable = useable;
 
-  if (config.cpu_vm_dpmi == CPUVM_NATIVE)
-  {
-    /* NOTE: the real LDT in kernel space uses the real addresses, but
-       the LDT we emulate, and DOS applications work with,
-       has all base addresses with respect to mem_base */
-    if (base || limit) {
-      ldt_info.base_addr += (uintptr_t)mem_base;
-      __retval = modify_ldt(LDT_WRITE, &ldt_info, sizeof(ldt_info));
-      ldt_info.base_addr -= (uintptr_t)mem_base;
-    } else {
-      __retval = modify_ldt(LDT_WRITE, &ldt_info, sizeof(ldt_info));
-    }
-    if (__retval)
-      return __retval;
-  }
+  if (config.cpu_vm_dpmi == CPUVM_NATIVE && entry >= 0 &&
+      entry < LDT_ENTRIES)
+    memcpy(old, &ldt_buffer[entry * LDT_ENTRY_SIZE], LDT_ENTRY_SIZE);
 
 /*
  * DANG_BEGIN_REMARK
@@ -284,7 +307,19 @@ static int set_ldt_entry(int entry, unsigned long base, unsigned int limit,
  */
 
   __retval = emu_modify_ldt(LDT_WRITE, &ldt_info, sizeof(ldt_info));
-  return __retval;
+  /* emu_modify_ldt() rejects everything the kernel would reject */
+  if (__retval || config.cpu_vm_dpmi != CPUVM_NATIVE)
+    return __retval;
+  /* if unchanged, the kernel already has it or it is still pending */
+  if (memcmp(old, &ldt_buffer[entry * LDT_ENTRY_SIZE], LDT_ENTRY_SIZE) == 0)
+    return 0;
+  ldt_pending[entry] = ldt_info;
+  ldt_dirty[entry >> 3] |= 1 << (entry & 7);
+  if (entry < ldt_dirty_lo)
+    ldt_dirty_lo = entry;
+  if (entry > ldt_dirty_hi)
+    ldt_dirty_hi = entry;
+  return 0;
 }
 
 static void _print_dt(char *buffer, int nsel, int isldt) /* stolen from WINE */
@@ -493,6 +528,7 @@ void dpmi_iret_unwind(sigcontext_t *scp)
 
 static int do_dpmi_control(sigcontext_t *scp)
 {
+    ldt_flush();
     if (in_dpmi_thr)
       signal_switch_to_dpmi();
     dpmi_thr_running++;
@@ -824,6 +860,7 @@ int ValidAndUsedSelector(unsigned short selector)
 static inline int check_verr(unsigned short selector)
 {
   int ret;
+  ldt_flush();
   asm volatile(
     "verrw %%ax\n"
     "jz 1f\n"
@@ -1059,9 +1096,9 @@ static inline int do_LAR(us selector)
 #ifdef X86_EMULATOR
   if (config.cpu_vm_dpmi != CPUVM_NATIVE)
     return emu_do_LAR(selector);
-  else
 #endif
-    asm volatile(
+  ldt_flush();
+  asm volatile(
       "larw %%ax,%%ax\n"
       "jz 1f\n"
       "xorl %%eax,%%eax\n"
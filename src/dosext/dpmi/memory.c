@@ -81,11 +81,87 @@ void dpmi_set_mem_bases(void *rsv_base, void *main_base)
 
 /* utility routines */
 
-/* I don\'t think these function will ever become bottleneck, so just */
-/* keep it simple, --dong */
+/* Blocks are found by handle through a per-root hash and by address
+ * through a page table covering the whole 4Gb space, which maps every
+ * page to the block it belongs to. The page table is global: handles
+ * are unique across all roots, so the owner of a block is checked by
+ * looking its handle up in the root's hash.
+ * Blocks may only overlap if the same hardware RAM was mapped twice.
+ * Such a block stays out of the page table and is found by walking
+ * the list, which is only done while there are any. */
+#define PM_IDX_BITS 10
+#define PM_IDX_SIZE (1 << PM_IDX_BITS)
+#define PM_DIR_SIZE (1 << (32 - PAGE_SHIFT - PM_IDX_BITS))
+
+static dpmi_pm_block **pm_page_idx[PM_DIR_SIZE];
+static int pm_unindexed;
+
+static dpmi_pm_block **page_slot(dosaddr_t addr, int create)
+{
+    unsigned page = addr >> PAGE_SHIFT;
+    dpmi_pm_block ***dir = &pm_page_idx[page >> PM_IDX_BITS];
+
+    if (!*dir) {
+	if (!create)
+	    return NULL;
+	*dir = calloc(PM_IDX_SIZE, sizeof(dpmi_pm_block *));
+	if (!*dir)
+	    return NULL;
+    }
+    return &(*dir)[page & (PM_IDX_SIZE - 1)];
+}
+
+static void unindex_pages(dpmi_pm_block *p, unsigned int npages)
+{
+    unsigned int i;
+
+    for (i = 0; i < npages; i++) {
+	dpmi_pm_block **slot = page_slot(p->base + (i << PAGE_SHIFT), 0);
+	if (slot && *slot == p)
+	    *slot = NULL;
+    }
+}
+
+static void index_pages(dpmi_pm_block *p)
+{
+    unsigned int i, npages = p->size >> PAGE_SHIFT;
+
+    for (i = 0; i < npages; i++) {
+	dpmi_pm_block **slot = page_slot(p->base + (i << PAGE_SHIFT), 1);
+	if (!slot || *slot) {
+	    unindex_pages(p, i);
+	    p->noidx = 1;
+	    pm_unindexed++;
+	    D_printf("DPMI: block %#x at %#x not indexed\n", p->handle, p->base);
+	    return;
+	}
+	*slot = p;
+    }
+}
+
+static void unindex_block(dpmi_pm_block *p)
+{
+    if (p->noidx) {
+	p->noidx = 0;
+	pm_unindexed--;
+	return;
+    }
+    unindex_pages(p, p->size >> PAGE_SHIFT);
+}
+
+/* set the new place of a block, keeping the page table in sync */
+static void move_pm_block(dpmi_pm_block *p, dosaddr_t base, unsigned int size)
+{
+    unindex_block(p);
+    p->base = base;
+    p->size = size;
+    index_pages(p);
+}
+
 /* alloc_pm_block: allocate a dpmi_pm_block struct and add it to the list */
 static dpmi_pm_block * alloc_pm_block(dpmi_pm_block_root *root, unsigned long size)
 {
+    dpmi_pm_block **bucket;
     dpmi_pm_block *p = malloc(sizeof(dpmi_pm_block));
     if(!p)
 	return NULL;
@@ -95,8 +171,12 @@ static dpmi_pm_block * alloc_pm_block(dpmi_pm_block_root *root, unsigned long si
 	free(p);
 	return NULL;
     }
+    p->handle = pm_block_handle_used++;
     p->next = root->first_pm_block;	/* add it to list */
     root->first_pm_block = p;
+    bucket = &root->hash[p->handle % PM_HASH_SIZE];
+    p->hnext = *bucket;
+    *bucket = p;
     return p;
 }
 
@@ -114,6 +194,7 @@ static int free_pm_block(dpmi_pm_block_root *root, dpmi_pm_block *p)
 {
     dpmi_pm_block *tmp = NULL;
     dpmi_pm_block *next;
+    dpmi_pm_block **hp;
     if (!p) return -1;
     if (p != root->first_pm_block) {
 	for(tmp = root->first_pm_block; tmp; tmp = tmp->next)
@@ -121,6 +202,13 @@ static int free_pm_block(dpmi_pm_block_root *root, dpmi_pm_block *p)
 		break;
 	if (!tmp) return -1;
     }
+    for (hp = &root->hash[p->handle % PM_HASH_SIZE]; *hp; hp = &(*hp)->hnext) {
+	if (*hp == p) {
+	    *hp = p->hnext;
+	    break;
+	}
+    }
+    unindex_block(p);
     next = p->next;
     free(p->attrs);
     free(p->shmname);
@@ -137,7 +225,7 @@ static int free_pm_block(dpmi_pm_block_root *root, dpmi_pm_block *p)
 dpmi_pm_block *lookup_pm_block(dpmi_pm_block_root *root, unsigned long h)
 {
     dpmi_pm_block *tmp;
-    for(tmp = root->first_pm_block; tmp; tmp = tmp->next) {
+    for(tmp = root->hash[h % PM_HASH_SIZE]; tmp; tmp = tmp->hnext) {
 	if (tmp -> handle == h)
 	    return tmp;
     }
@@ -148,6 +236,12 @@ dpmi_pm_block *lookup_pm_block_by_addr(dpmi_pm_block_root *root,
 	dosaddr_t addr)
 {
     dpmi_pm_block *tmp;
+    dpmi_pm_block **slot = page_slot(addr, 0);
+
+    if (slot && *slot && lookup_pm_block(root, (*slot)->handle) == *slot)
+	return *slot;
+    if (!pm_unindexed)
+	return NULL;
     for(tmp = root->first_pm_block; tmp; tmp = tmp->next) {
 	if (addr >= tmp->base && addr < tmp->base + tmp->size)
 	    return tmp;
@@ -232,9 +326,13 @@ int dpmi_alloc_pool(void)
     c_printf("DPMI: mem init, mpool is %d bytes at %p\n", memsize, dpmi_base);
     /* Create DPMI pool */
     sminit_com(&mem_pool, dpmi_base, memsize, commit, uncommit);
-    if (dpmi_lin_rsv_base)
+    /* uncommit() maps fresh anonymous pages, no need to clear them */
+    smset_flags(&mem_pool, SM_ZEROED_COMMIT);
+    if (dpmi_lin_rsv_base) {
 	sminit_com(&lin_pool, dpmi_lin_rsv_base, dpmi_lin_mem_rsv(),
 		commit, uncommit);
+	smset_flags(&lin_pool, SM_ZEROED_COMMIT);
+    }
     dpmi_total_memory = config.dpmi * 1024;
 
     D_printf("DPMI: dpmi_free_memory available 0x%lx\n", dpmi_total_memory);
@@ -253,7 +351,12 @@ void dpmi_free_pool(void)
     }
 }
 
-static int SetAttribsForPage(unsigned int ptr, us attr, us *old_attr_p)
+/* Updates the attributes of one page. The protection the page needs is
+ * returned in *r_prot (PROT_NONE means uncommit), or -1 if the mapping
+ * doesn't change. The caller applies it, so that runs of pages can be
+ * done with one call. */
+static int SetAttribsForPage(unsigned int ptr, us attr, us *old_attr_p,
+	int *r_prot)
 {
     us old_attr = *old_attr_p;
     int prot, change = 0, com = attr & 3, old_com = old_attr & 1;
@@ -362,29 +465,37 @@ static int SetAttribsForPage(unsigned int ptr, us attr, us *old_attr_p)
 
     D_printf("Addr=%#x\n", ptr);
 
-    if (change) {
-      e_invalidate_full(ptr, PAGE_SIZE);
-      if (com) {
-        if (mprotect_mapping(MAPPING_DPMI, ptr, PAGE_SIZE, prot) == -1) {
-          leavedos(2);
-          return 0;
-        }
-      } else {
-        if (mmap_mapping(MAPPING_DPMI | MAPPING_SCRATCH,
-            ptr, PAGE_SIZE, PROT_NONE) == MAP_FAILED) {
-          D_printf("mmap() failed: %s\n", strerror(errno));
-          return 0;
-        }
-      }
-    }
-
+    *r_prot = change ? (com ? prot : PROT_NONE) : -1;
     return 1;
 }
 
+/* apply one protection to a run of pages; under KVM this also updates
+ * the monitor page tables for the whole run at once */
+static int protect_pages(dosaddr_t ptr, int npages, int prot)
+{
+  size_t size = (size_t)npages << PAGE_SHIFT;
+
+  e_invalidate_full(ptr, size);
+  if (prot != PROT_NONE) {
+    if (mprotect_mapping(MAPPING_DPMI, ptr, size, prot) == -1) {
+      leavedos(2);
+      return 0;
+    }
+  } else {
+    if (mmap_mapping(MAPPING_DPMI | MAPPING_SCRATCH,
+        ptr, size, PROT_NONE) == MAP_FAILED) {
+      D_printf("mmap() failed: %s\n", strerror(errno));
+      return 0;
+    }
+  }
+  return 1;
+}
+
 static int SetPageAttributes(dpmi_pm_block *block, int offs, us attrs[], int count)
 {
   u_short *attr;
-  int i;
+  int i, prot, ok = 1;
+  int run_start = 0, run_len = 0, run_prot = -1;
 
   for (i = 0; i < count; i++) {
     attr = block->attrs + (offs >> PAGE_SHIFT) + i;
@@ -393,23 +504,51 @@ static int SetPageAttributes(dpmi_pm_block *block, int offs, us attrs[], int cou
     }
     if ((*attr & ATTR_SHR) && ((attrs[i] & 7) != 3)) {
       D_printf("Disallow change type of shared page\n");
-      return 0;
+      ok = 0;
+      break;
     }
     D_printf("%i\t", i);
     if (!SetAttribsForPage(block->base + offs + (i << PAGE_SHIFT),
-	attrs[i], attr))
+	attrs[i], attr, &prot)) {
+      ok = 0;
+      break;
+    }
+    if (prot == -1)
+      continue;
+    if (run_len && prot == run_prot && run_start + run_len == i) {
+      run_len++;
+      continue;
+    }
+    if (run_len && !protect_pages(block->base + offs +
+	(run_start << PAGE_SHIFT), run_len, run_prot))
       return 0;
+    run_start = i;
+    run_len = 1;
+    run_prot = prot;
   }
-  return 1;
+  /* pages before a failing one were already updated, as before */
+  if (run_len && !protect_pages(block->base + offs +
+      (run_start << PAGE_SHIFT), run_len, run_prot))
+    return 0;
+  return ok;
 }
 
 static void restore_page_protection(dpmi_pm_block *block)
 {
-  int i;
-  for (i = 0; i < block->size >> PAGE_SHIFT; i++) {
-    if ((block->attrs[i] & 7) == 0) {
+  int i, start = -1;
+  int npages = block->size >> PAGE_SHIFT;
+
+  for (i = 0; i <= npages; i++) {
+    if (i < npages && (block->attrs[i] & 7) == 0) {
+      if (start == -1)
+        start = i;
+      continue;
+    }
+    if (start != -1) {
       mmap_mapping(MAPPING_DPMI | MAPPING_SCRATCH,
-            block->base + (i << PAGE_SHIFT), PAGE_SIZE, PROT_NONE);
+            block->base + (start << PAGE_SHIFT),
+            (i - start) << PAGE_SHIFT, PROT_NONE);
+      start = -1;
     }
   }
 }
@@ -431,13 +570,11 @@ dpmi_pm_block * DPMI_malloc(dpmi_pm_block_root *root, unsigned int size)
 	free_pm_block(root, block);
 	return NULL;
     }
-    block->base = DOSADDR_REL(realbase);
+    move_pm_block(block, DOSADDR_REL(realbase), size);
     block->linear = 0;
     for (i = 0; i < size >> PAGE_SHIFT; i++)
 	block->attrs[i] = 9;
     dpmi_free_memory -= size;
-    block->handle = pm_block_handle_used++;
-    block->size = size;
     return block;
 }
 
@@ -495,14 +632,12 @@ dpmi_pm_block * DPMI_mallocLinear(dpmi_pm_block_root *root,
 	    return NULL;
 	}
     }
-    block->base = DOSADDR_REL(realbase);
+    move_pm_block(block, DOSADDR_REL(realbase), size);
     block->linear = 1;
     for (i = 0; i < size >> PAGE_SHIFT; i++)
 	block->attrs[i] = committed ? 9 : 8;
     if (committed)
 	dpmi_free_memory -= size;
-    block->handle = pm_block_handle_used++;
-    block->size = size;
     return block;
 }
 
@@ -518,12 +653,10 @@ dpmi_pm_block * DPMI_mapHWRam(dpmi_pm_block_root *root,
 	return NULL;
     if ((block = alloc_pm_block(root, size)) == NULL)
 	return NULL;
-    block->base = vbase;
+    move_pm_block(block, vbase, size);
     block->linear = 1;
     for (i = 0; i < size >> PAGE_SHIFT; i++)
 	block->attrs[i] = 9;
-    block->handle = pm_block_handle_used++;
-    block->size = size;
     return block;
 }
 
@@ -563,10 +696,71 @@ int DPMI_free(dpmi_pm_block_root *root, unsigned int handle)
     return 0;
 }
 
+#ifdef HAVE_MEMFD_CREATE
+/* The shared memory names are private to this dosemu process, so the
+ * objects are memfds kept in a list by name rather than files in
+ * /dev/shm, which may be missing or mounted noexec. */
+struct dpmi_shm {
+    char *name;
+    int fd;
+    struct dpmi_shm *next;
+};
+static struct dpmi_shm *dpmi_shms;
+
+static int shm_unlink_fd(const char *name)
+{
+    struct dpmi_shm **p, *shm;
+
+    for (p = &dpmi_shms; *p; p = &(*p)->next) {
+	if (strcmp((*p)->name, name) == 0) {
+	    shm = *p;
+	    *p = shm->next;
+	    close(shm->fd);
+	    free(shm->name);
+	    free(shm);
+	    return 0;
+	}
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+static int shm_open_fd(const char *name, int oflags)
+{
+    struct dpmi_shm *shm;
+    int fd;
+
+    for (shm = dpmi_shms; shm; shm = shm->next) {
+	if (strcmp(shm->name, name) == 0)
+	    return dup(shm->fd);
+    }
+    if (!(oflags & O_CREAT)) {
+	errno = ENOENT;
+	return -1;
+    }
+    fd = memfd_create(name + 1, MFD_CLOEXEC);
+    if (fd == -1)
+	return -1;
+    shm = malloc(sizeof(*shm));
+    if (!shm) {
+	close(fd);
+	return -1;
+    }
+    shm->name = strdup(name);
+    shm->fd = fd;
+    shm->next = dpmi_shms;
+    dpmi_shms = shm;
+    return dup(fd);
+}
+#elif defined(HAVE_SHM_OPEN)
+#define shm_open_fd(n, o) shm_open(n, o, S_IRUSR | S_IWUSR)
+#define shm_unlink_fd shm_unlink
+#endif
+
 dpmi_pm_block *DPMI_mallocShared(dpmi_pm_block_root *root,
         char *name, unsigned int size, unsigned int shmsize, int flags)
 {
-#ifdef HAVE_SHM_OPEN
+#if defined(HAVE_MEMFD_CREATE) || defined(HAVE_SHM_OPEN)
     int i;
     int fd;
     dpmi_pm_block *ptr;
@@ -591,7 +785,7 @@ dpmi_pm_block *DPMI_mallocShared(dpmi_pm_block_root *root,
     asprintf(&shmname, "/dosemu_dpmishm_%d_%s", getpid(), name);
     if (init)
         oflags |= O_CREAT;
-    fd = shm_open(shmname, oflags, S_IRUSR | S_IWUSR);
+    fd = shm_open_fd(shmname, oflags);
     if (fd == -1) {
         perror("shm_open()");
         error("shared memory unavailable, exiting\n");
@@ -616,11 +810,9 @@ dpmi_pm_block *DPMI_mallocShared(dpmi_pm_block_root *root,
         return NULL;
     for (i = 0; i < (size >> PAGE_SHIFT); i++)
         ptr->attrs[i] = 0x09 | ATTR_SHR;	// RW, shared, present
-    ptr->base = DOSADDR_REL(addr);
-    ptr->size = size;
+    move_pm_block(ptr, DOSADDR_REL(addr), size);
     ptr->shmsize = shmsize;
     ptr->linear = 1;
-    ptr->handle = pm_block_handle_used++;
     ptr->shmname = strdup(name);
     ptr->rshmname = shmname;
     D_printf("DPMI: map shm %s\n", ptr->shmname);
@@ -638,7 +830,7 @@ int DPMI_freeShared(dpmi_pm_block_root *root, uint32_t handle, int unlnk)
     munmap_mapping(MAPPING_DPMI, ptr->base, ptr->size);
     if (unlnk) {
         D_printf("DPMI: unlink shm %s\n", ptr->rshmname);
-        shm_unlink(ptr->rshmname);
+        shm_unlink_fd(ptr->rshmname);
     }
     free_pm_block(root, ptr);
     return 0;
@@ -698,8 +890,7 @@ dpmi_pm_block * DPMI_realloc(dpmi_pm_block_root *root,
 	return NULL;
 
     finish_realloc(block, newsize, 1);
-    block->base = DOSADDR_REL(ptr);
-    block->size = newsize;
+    move_pm_block(block, DOSADDR_REL(ptr), newsize);
     restore_page_protection(block);
     return block;
 }
@@ -756,8 +947,7 @@ dpmi_pm_block * DPMI_reallocLinear(dpmi_pm_block_root *root,
     }
 
     finish_realloc(block, newsize, committed);
-    block->base = DOSADDR_REL(ptr);
-    block->size = newsize;
+    move_pm_block(block, DOSADDR_REL(ptr), newsize);
     restore_page_protection(block);
     return block;
 }
@@ -226,6 +226,10 @@ void msdos_ldt_write(sigcontext_t *scp, uint32_t op, int len)
     direct_ldt_write(scp, _cr2 - (unsigned long)ldt_alias, (char *)&op, len);
 }
 
+/* Client writes to the alias trap here and go to the LDT at once.
+ * The alias can not be left writable and synced later: a client that
+ * rewrites a live descriptor and then reloads its selector gets no
+ * fault, and would run on the stale entry until the next sync. */
 int msdos_ldt_pagefault(sigcontext_t *scp)
 {
     uint32_t op;
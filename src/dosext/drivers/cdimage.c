@@ -0,0 +1,325 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: ISO9660 image files as CD-ROM media.
+ *
+ * A READ LONG of any number of sectors is a single pread(). The image
+ * is not mapped: the file may be rewritten while in use, which the
+ * media change check catches, but a mapping would turn it into SIGBUS.
+ * On open the directory tree is walked once and every entry goes into
+ * a hash table keyed by its full path, the way MSCDEX GetDirectoryEntry
+ * looks names up: without the ';' version suffix and a trailing '.'.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <linux/cdrom.h>
+
+#include "emu.h"
+#include "dos2linux.h"
+#include "cdimage.h"
+
+#define ISO_PVD_SECTOR		16
+#define ISO_ROOT_REC		156
+#define ISO_MAX_DEPTH		32
+#define CDIMG_HASH_BITS		10
+
+struct cd_dirent {
+    char *path;
+    unsigned sector;		/* where the directory record lives */
+    unsigned offset;
+    struct cd_dirent *next;
+};
+
+struct cd_image {
+    char *path;
+    int fd;
+    off_t size;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    unsigned nsect;
+    unsigned hash_size;
+    unsigned nents;
+    struct cd_dirent **hash;
+};
+
+static unsigned path_hash(const char *s, unsigned len)
+{
+    unsigned h = 5381;
+
+    while (len--)
+	h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+static int read_sector(struct cd_image *ci, unsigned sector,
+	unsigned char *buf)
+{
+    if (sector >= ci->nsect)
+	return -1;
+    if (RPT_SYSCALL(pread(ci->fd, buf, CD_FRAMESIZE,
+	    (off_t)sector * CD_FRAMESIZE)) != CD_FRAMESIZE)
+	return -1;
+    return 0;
+}
+
+static struct cd_dirent *index_find(struct cd_image *ci, const char *path,
+	unsigned len)
+{
+    struct cd_dirent *de;
+
+    de = ci->hash[path_hash(path, len) & (ci->hash_size - 1)];
+    for (; de; de = de->next) {
+	if (strlen(de->path) == len && memcmp(de->path, path, len) == 0)
+	    return de;
+    }
+    return NULL;
+}
+
+/* first entry in directory order wins, as with the linear search */
+static void index_add(struct cd_image *ci, const char *path, unsigned len,
+	unsigned sector, unsigned offset)
+{
+    struct cd_dirent *de;
+    unsigned h;
+
+    if (index_find(ci, path, len))
+	return;
+    de = malloc(sizeof(*de));
+    if (!de)
+	return;
+    de->path = strndup(path, len);
+    de->sector = sector;
+    de->offset = offset;
+    h = path_hash(path, len) & (ci->hash_size - 1);
+    de->next = ci->hash[h];
+    ci->hash[h] = de;
+    ci->nents++;
+}
+
+/* the sector buffer is on the heap, so that deep trees do not eat
+ * the stack of the thread that opens the image */
+static void index_dir(struct cd_image *ci, const char *prefix,
+	unsigned sector, unsigned size, int depth)
+{
+    unsigned char *sbuf;
+    unsigned nsect = (size + CD_FRAMESIZE - 1) / CD_FRAMESIZE;
+    unsigned s;
+
+    if (depth > ISO_MAX_DEPTH)
+	return;
+    sbuf = malloc(CD_FRAMESIZE);
+    if (!sbuf)
+	return;
+    for (s = 0; s < nsect; s++) {
+	unsigned index = 0;
+
+	if (read_sector(ci, sector + s, sbuf) == -1)
+	    break;
+	while (index + 33 <= CD_FRAMESIZE) {
+	    const unsigned char *rec = sbuf + index;
+	    unsigned reclen = rec[0];
+	    unsigned namelen = rec[32];
+	    const char *name = (const char *)rec + 33;
+	    const char *semi;
+	    char *path;
+	    int plen;
+	    unsigned klen;
+
+	    if (reclen == 0)
+		break;
+	    if (reclen < 33 || index + reclen > CD_FRAMESIZE ||
+		    33 + namelen > reclen)
+		break;
+	    index += reclen;
+	    /* skip "." and ".." */
+	    if (namelen == 1 && (name[0] == 0 || name[0] == 1))
+		continue;
+	    /* the key is "NAME.EXT" for "NAME.EXT;1" and "NAME" for "NAME.;1" */
+	    semi = memchr(name, ';', namelen);
+	    klen = semi ? semi - name : namelen;
+	    if (klen > 1 && name[klen - 1] == '.')
+		klen--;
+	    plen = asprintf(&path, "%s%s%.*s", prefix, prefix[0] ? "\\" : "",
+		    (int)klen, name);
+	    if (plen < 0)
+		continue;
+	    index_add(ci, path, plen, sector + s, rec - sbuf);
+	    if (rec[25] & 2) {
+		unsigned ext = rec[2] | (rec[3] << 8) | (rec[4] << 16) |
+		    ((unsigned)rec[5] << 24);
+		unsigned len = rec[10] | (rec[11] << 8) | (rec[12] << 16) |
+		    ((unsigned)rec[13] << 24);
+
+		index_dir(ci, path, ext, len, depth + 1);
+	    }
+	    free(path);
+	}
+    }
+    free(sbuf);
+}
+
+static void index_build(struct cd_image *ci)
+{
+    unsigned char pvd[CD_FRAMESIZE];
+    const unsigned char *root;
+    unsigned ext, len;
+
+    if (read_sector(ci, ISO_PVD_SECTOR, pvd) == -1 ||
+	    memcmp(pvd + 1, "CD001", 5) != 0) {
+	C_printf("CDROM: image is not ISO9660, no directory index\n");
+	return;
+    }
+    root = pvd + ISO_ROOT_REC;
+    ext = root[2] | (root[3] << 8) | (root[4] << 16) |
+	((unsigned)root[5] << 24);
+    len = root[10] | (root[11] << 8) | (root[12] << 16) |
+	((unsigned)root[13] << 24);
+    ci->hash_size = 1 << CDIMG_HASH_BITS;
+    ci->hash = calloc(ci->hash_size, sizeof(*ci->hash));
+    if (!ci->hash)
+	return;
+    index_dir(ci, "", ext, len, 0);
+    C_printf("CDROM: indexed %u directory entries\n", ci->nents);
+}
+
+static void index_free(struct cd_image *ci)
+{
+    unsigned i;
+
+    if (!ci->hash)
+	return;
+    for (i = 0; i < ci->hash_size; i++) {
+	struct cd_dirent *de = ci->hash[i];
+
+	while (de) {
+	    struct cd_dirent *next = de->next;
+
+	    free(de->path);
+	    free(de);
+	    de = next;
+	}
+    }
+    free(ci->hash);
+    ci->hash = NULL;
+}
+
+struct cd_image *cdimg_open(const char *path)
+{
+    struct cd_image *ci;
+    struct stat st;
+    int fd;
+
+    if (stat(path, &st) == -1 || !S_ISREG(st.st_mode))
+	return NULL;
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+	C_printf("CDROM: can't open image %s: %s\n", path, strerror(errno));
+	return NULL;
+    }
+    ci = calloc(1, sizeof(*ci));
+    if (!ci) {
+	close(fd);
+	return NULL;
+    }
+    ci->path = strdup(path);
+    ci->fd = fd;
+    ci->size = st.st_size;
+    ci->dev = st.st_dev;
+    ci->ino = st.st_ino;
+    ci->mtime = st.st_mtime;
+    ci->nsect = st.st_size / CD_FRAMESIZE;
+    index_build(ci);
+    C_printf("CDROM: image %s, %u sectors\n", path, ci->nsect);
+    return ci;
+}
+
+void cdimg_close(struct cd_image *ci)
+{
+    index_free(ci);
+    close(ci->fd);
+    free(ci->path);
+    free(ci);
+}
+
+/* read count sectors either to buf or, if buf is NULL, to DOS memory */
+int cdimg_read(struct cd_image *ci, unsigned char *buf, unsigned dosbuf,
+	unsigned sector, unsigned count)
+{
+    off_t pos = (off_t)sector * CD_FRAMESIZE;
+    size_t len;
+
+    if (sector >= ci->nsect)
+	return 0;
+    if (count > ci->nsect - sector)
+	count = ci->nsect - sector;
+    len = (size_t)count * CD_FRAMESIZE;
+    if (buf)
+	return RPT_SYSCALL(pread(ci->fd, buf, len, pos));
+    return dos_pread(ci->fd, dosbuf, len, pos);
+}
+
+unsigned cdimg_num_sectors(const struct cd_image *ci)
+{
+    return ci->nsect;
+}
+
+/* the image file was replaced or rewritten: a new disc was inserted */
+int cdimg_changed(const struct cd_image *ci)
+{
+    struct stat st;
+
+    if (stat(ci->path, &st) == -1)
+	return 1;
+    return (st.st_dev != ci->dev || st.st_ino != ci->ino ||
+	    st.st_mtime != ci->mtime || st.st_size != ci->size);
+}
+
+/* copy the directory record of path to rec (256 bytes), returns its
+ * length, 0 if not found or -1 if there is no index. The index of an
+ * image that changed is dropped, it is built again when the media
+ * change is reported and the image is reopened. */
+int cdimg_lookup(struct cd_image *ci, const char *path, unsigned char *rec)
+{
+    unsigned char sec[CD_FRAMESIZE];
+    struct cd_dirent *de;
+    const char *semi = strchr(path, ';');
+    unsigned len = semi ? semi - path : strlen(path);
+
+    if (!ci->hash)
+	return -1;
+    if (cdimg_changed(ci)) {
+	C_printf("CDROM: image changed, dropping the directory index\n");
+	index_free(ci);
+	return -1;
+    }
+    if (len > 1 && path[len - 1] == '.')
+	len--;
+    de = index_find(ci, path, len);
+    if (!de)
+	return 0;
+    if (read_sector(ci, de->sector, sec) == -1)
+	return 0;
+    memcpy(rec, sec + de->offset, sec[de->offset]);
+    return sec[de->offset];
+}
@@ -36,13 +36,16 @@
 
 #include "emu.h"
 #include "dos2linux.h"
+#include "cdimage.h"
 
 #undef CDROM_DEBUG
 
 static int CdromFd[4] = { -1, -1, -1, -1 };
+static struct cd_image *CdImage[4];
 
 static int IndexCd = -1;
 #define cdrom_fd CdromFd[IndexCd]
+#define cdrom_img CdImage[IndexCd]
 
 static int cdu33a = 0;
 
@@ -217,6 +220,209 @@ static void cdrom_reset(void)
 #define MSCD_AUDCHAN_VOLUME2       6
 #define MSCD_AUDCHAN_VOLUME3       8
 
+static unsigned int read_start_sector(unsigned char *req_buf)
+{
+    if (*CALC_PTR(req_buf, MSCD_READ_ADRESSING, u_char) == 1)
+	return *CALC_PTR(req_buf, MSCD_READ_STARTSECTOR + 2, u_char) * 60 * 75 +
+	    *CALC_PTR(req_buf, MSCD_READ_STARTSECTOR + 1, u_char) * 75 +
+	    *CALC_PTR(req_buf, MSCD_READ_STARTSECTOR + 0, u_char) - 150;
+    return *CALC_PTR(req_buf, MSCD_READ_STARTSECTOR, u_long);
+}
+
+static void put_msf(unsigned char *p, unsigned int sector_plus_150)
+{
+    p[3] = 0;
+    p[2] = sector_plus_150 / (60 * 75);
+    p[1] = (sector_plus_150 % (60 * 75)) / 75;
+    p[0] = sector_plus_150 % 75;
+}
+
+static void put_audio_status(unsigned char *req_buf)
+{
+    *CALC_PTR(req_buf, MSCD_AUDSTAT_PAUSED, u_short) =
+	audio_status.paused_bit;
+    *CALC_PTR(req_buf, MSCD_AUDSTAT_START, u_long) =
+	audio_status.last_StartSector;
+    *CALC_PTR(req_buf, MSCD_AUDSTAT_END, u_long) =
+	audio_status.last_EndSector;
+}
+
+static void put_audio_channels(unsigned char *req_buf)
+{
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME0, u_char) =
+	audio_status.volume0;
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME1, u_char) =
+	audio_status.volume1;
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME2, u_char) =
+	audio_status.volume2;
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME3, u_char) =
+	audio_status.volume3;
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME0 - 1, u_char) =
+	audio_status.outchan0;
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME1 - 1, u_char) =
+	audio_status.outchan1;
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME2 - 1, u_char) =
+	audio_status.outchan2;
+    *CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME3 - 1, u_char) =
+	audio_status.outchan3;
+}
+
+static void get_audio_channels(unsigned char *req_buf)
+{
+    audio_status.volume0 = *CALC_PTR(req_buf, MSCD_CTRL_VOLUME0, u_char);
+    audio_status.volume1 = *CALC_PTR(req_buf, MSCD_CTRL_VOLUME1, u_char);
+    audio_status.volume2 = *CALC_PTR(req_buf, MSCD_CTRL_VOLUME2, u_char);
+    audio_status.volume3 = *CALC_PTR(req_buf, MSCD_CTRL_VOLUME3, u_char);
+    audio_status.outchan0 =
+	*CALC_PTR(req_buf, MSCD_CTRL_VOLUME0 - 1, u_char);
+    audio_status.outchan1 =
+	*CALC_PTR(req_buf, MSCD_CTRL_VOLUME1 - 1, u_char);
+    audio_status.outchan2 =
+	*CALC_PTR(req_buf, MSCD_CTRL_VOLUME2 - 1, u_char);
+    audio_status.outchan3 =
+	*CALC_PTR(req_buf, MSCD_CTRL_VOLUME3 - 1, u_char);
+}
+
+/* ISO image backend: a single data track, no ioctls, no audio */
+static void cdrom_image_helper(unsigned char *req_buf,
+			       unsigned char *transfer_buf,
+			       unsigned int dos_transfer_buf)
+{
+    unsigned int Sector, nsect = cdimg_num_sectors(cdrom_img);
+    int n, len;
+
+    switch (HI(ax)) {
+    case 0x02:			/* read long */
+	if (req_buf == NULL && transfer_buf == NULL) {
+	    req_buf = SEG_ADR((unsigned char *), es, di);
+	    dos_transfer_buf = SEGOFF2LINEAR(SREG(ds), LWORD(esi));
+	}
+	Sector = read_start_sector(req_buf);
+	n = *CALC_PTR(req_buf, MSCD_READ_NUMSECTORS, u_short);
+	C_printf("CDROM: image: reading %d sectors at %#x\n", n, Sector);
+	len = cdimg_read(cdrom_img, transfer_buf, dos_transfer_buf, Sector, n);
+	if (len != n * CD_FRAMESIZE) {
+	    C_printf("CDROM: sector read len %#x got %#x\n",
+		     n * CD_FRAMESIZE, len);
+	    LO(ax) = 1;
+	    HI(ax) = 0x0F;
+	} else
+	    LO(ax) = 0;
+	break;
+    case 0x03:			/* seek */
+    case 0x0B:			/* drive reset */
+    case 0x0D:			/* eject */
+    case 0x0E:			/* close tray */
+	LO(ax) = 0;
+	break;
+    case 0x04:			/* play */
+	LO(ax) = 1;		/* no audio tracks */
+	break;
+    case 0x05:			/* pause (stop) audio */
+	audio_status.last_StartSector = 0;
+	audio_status.last_EndSector = 0;
+	audio_status.paused_bit = 0;
+	LO(ax) = 0;
+	break;
+    case 0x06:			/* resume audio */
+	LO(ax) = 1;
+	break;
+    case 0x07:			/* location of head */
+	LWORD(eax) = 0;
+	req_buf = SEG_ADR((unsigned char *), ds, si);
+	if (*CALC_PTR(req_buf, MSCD_LOCH_ADRESSING, u_char) == 0)
+	    *CALC_PTR(req_buf, MSCD_LOCH_LOCATION, u_long) = 0;
+	else
+	    put_msf(CALC_PTR(req_buf, MSCD_LOCH_LOCATION, u_char), 150);
+	break;
+    case 0x08:			/* return sectorsize */
+	LO(ax) = 0;
+	LWORD(ebx) = CD_FRAMESIZE;
+	break;
+    case 0x09:			/* media changed */
+	HI(ax) = 0;
+	LO(ax) = 0;
+	LO(bx) = 0;
+	if (audio_status.media_changed || cdimg_changed(cdrom_img)) {
+	    C_printf("CDROM: image changed, reopening\n");
+	    audio_status.media_changed = 0;
+	    cdimg_close(cdrom_img);
+	    cdrom_img = cdimg_open(path_cdrom);
+	    LO(bx) = 1;
+	}
+	break;
+    case 0x0A:			/* device status */
+	HI(ax) = 0;
+	LO(ax) = 0;
+	LWORD(ebx) = audio_status.status;
+	break;
+    case 0x0C:			/* lock/unlock door */
+	if (LO(bx) == 1)
+	    audio_status.status &= 0xFFFFFFFD;
+	else
+	    audio_status.status |= 0x2;
+	LO(ax) = 0;
+	break;
+    case 0x0F:			/* audio channel control */
+	LWORD(eax) = 0;
+	get_audio_channels(SEG_ADR((unsigned char *), ds, si));
+	break;
+    case 0x10:			/* audio disk info */
+	LWORD(eax) = 0;
+	req_buf = SEG_ADR((unsigned char *), ds, si);
+	*CALC_PTR(req_buf, MSCD_DISKINFO_LTN, u_char) = 1;
+	*CALC_PTR(req_buf, MSCD_DISKINFO_HTN, u_char) = 1;
+	put_msf(CALC_PTR(req_buf, MSCD_DISKINFO_LEADOUT, u_char),
+		nsect + 150);
+	break;
+    case 0x11:			/* track info */
+	req_buf = SEG_ADR((unsigned char *), ds, si);
+	if (*CALC_PTR(req_buf, MSCD_TRACKINFO_TRACKNUM, u_char) != 1) {
+	    LO(ax) = 1;
+	    break;
+	}
+	put_msf(CALC_PTR(req_buf, MSCD_TRACKINFO_TRACKPOS, u_char), 150);
+	*CALC_PTR(req_buf, MSCD_TRACKINFO_CTRL, u_char) =
+	    CDROM_DATA_TRACK << 4 | 0x20;
+	LO(ax) = 0;
+	break;
+    case 0x12:			/* volume size */
+	req_buf = SEG_ADR((unsigned char *), ds, si);
+	*CALC_PTR(req_buf, MSCD_GETVOLUMESIZE_SIZE, int) = nsect;
+	LO(ax) = 0;
+	break;
+    case 0x13:			/* q channel */
+	LWORD(eax) = 0;
+	req_buf = SEG_ADR((unsigned char *), ds, si);
+	memset(CALC_PTR(req_buf, MSCD_QCHAN_CTRL, u_char), 0,
+	       MSCD_QCHAN_AFRM - MSCD_QCHAN_CTRL + 1);
+	*CALC_PTR(req_buf, MSCD_QCHAN_CTRL, u_char) =
+	    (CDROM_DATA_TRACK << 4) | 1;
+	*CALC_PTR(req_buf, MSCD_QCHAN_TNO, u_char) = 1;
+	*CALC_PTR(req_buf, MSCD_QCHAN_IND, u_char) = 1;
+	*CALC_PTR(req_buf, MSCD_QCHAN_ASEC, u_char) = 2;
+	break;
+    case 0x14:			/* audio status */
+	LWORD(eax) = 0;
+	put_audio_status(SEG_ADR((unsigned char *), ds, si));
+	break;
+    case 0x15:			/* get audio channel information */
+	LWORD(eax) = 0;
+	put_audio_channels(SEG_ADR((unsigned char *), ds, si));
+	break;
+    default:
+	C_printf("CDROM: unknown request %#x!\n", HI(ax));
+    }
+    C_printf("Leave cdrom request with return status %#x\n", LWORD(eax));
+}
+
+int cdrom_image_lookup(int unit, const char *path, unsigned char *rec)
+{
+    if (unit < 0 || unit >= 4 || !CdImage[unit])
+	return -1;
+    return cdimg_lookup(CdImage[unit], path, rec);
+}
+
 void cdrom_helper(unsigned char *req_buf, unsigned char *transfer_buf,
 		  unsigned int dos_transfer_buf)
 {
@@ -234,6 +440,14 @@ void cdrom_helper(unsigned char *req_buf, unsigned char *transfer_buf,
     IndexCd = (int) ((HI(ax) & 0xC0) >> 6);
     HI(ax) = HI(ax) & 0x3F;
 
+    /* image files are served without going through the block layer */
+    if (HI(ax) != 1 && cdu33a && cdrom_fd < 0 && !cdrom_img)
+	cdrom_img = cdimg_open(path_cdrom);
+    if (HI(ax) != 1 && cdrom_img) {
+	cdrom_image_helper(req_buf, transfer_buf, dos_transfer_buf);
+	return;
+    }
+
     if (HI(ax) != 1 && cdrom_fd < 0) {
 	if (!cdu33a) {
 	    LO(ax) = 1;		/* not initialized */
@@ -334,19 +548,7 @@ void cdrom_helper(unsigned char *req_buf, unsigned char *transfer_buf,
 	    dos_transfer_buf = SEGOFF2LINEAR(SREG(ds), LWORD(esi));
 	}
 
-	if (*CALC_PTR(req_buf, MSCD_READ_ADRESSING, u_char) == 1) {
-	    cdrom_msf.cdmsf_min0 =
-		*CALC_PTR(req_buf, MSCD_READ_STARTSECTOR + 2, u_char);
-	    cdrom_msf.cdmsf_sec0 =
-		*CALC_PTR(req_buf, MSCD_READ_STARTSECTOR + 1, u_char);
-	    cdrom_msf.cdmsf_frame0 =
-		*CALC_PTR(req_buf, MSCD_READ_STARTSECTOR + 0, u_char);
-	    Sector =
-		cdrom_msf.cdmsf_min0 * 60 * 75 +
-		cdrom_msf.cdmsf_sec0 * 75 + cdrom_msf.cdmsf_frame0 - 150;
-	} else {
-	    Sector = *CALC_PTR(req_buf, MSCD_READ_STARTSECTOR, u_long);
-	}
+	Sector = read_start_sector(req_buf);
 
 	C_printf("CDROM: reading sector %#x (fmt %d)\n", Sector,
 		 *CALC_PTR(req_buf, MSCD_READ_ADRESSING, u_char));
@@ -765,13 +967,7 @@ void cdrom_helper(unsigned char *req_buf, unsigned char *transfer_buf,
 	if (cdrom_subchnl.cdsc_audiostatus == CDROM_AUDIO_PLAY)
 	    HI(ax) = 1;
 
-	req_buf = SEG_ADR((unsigned char *), ds, si);
-	*CALC_PTR(req_buf, MSCD_AUDSTAT_PAUSED, u_short) =
-	    audio_status.paused_bit;
-	*CALC_PTR(req_buf, MSCD_AUDSTAT_START, u_long) =
-	    audio_status.last_StartSector;
-	*CALC_PTR(req_buf, MSCD_AUDSTAT_END, u_long) =
-	    audio_status.last_EndSector;
+	put_audio_status(SEG_ADR((unsigned char *), ds, si));
 	break;
     case 0x15:			/* get audio channel information */
 	LWORD(eax) = 0;
@@ -786,23 +982,7 @@ void cdrom_helper(unsigned char *req_buf, unsigned char *transfer_buf,
 	if (cdrom_subchnl.cdsc_audiostatus == CDROM_AUDIO_PLAY)
 	    HI(ax) = 1;
 
-	req_buf = SEG_ADR((unsigned char *), ds, si);
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME0, u_char) =
-	    audio_status.volume0;
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME1, u_char) =
-	    audio_status.volume1;
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME2, u_char) =
-	    audio_status.volume2;
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME3, u_char) =
-	    audio_status.volume3;
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME0 - 1, u_char) =
-	    audio_status.outchan0;
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME1 - 1, u_char) =
-	    audio_status.outchan1;
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME2 - 1, u_char) =
-	    audio_status.outchan2;
-	*CALC_PTR(req_buf, MSCD_AUDCHAN_VOLUME3 - 1, u_char) =
-	    audio_status.outchan3;
+	put_audio_channels(SEG_ADR((unsigned char *), ds, si));
 	break;
     default:
 	C_printf("CDROM: unknown request %#x!\n", HI(ax));
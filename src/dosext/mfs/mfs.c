@@ -189,6 +189,7 @@ TODO:
 #include "mangle.h"
 #include "utilities.h"
 #include "coopth.h"
+#include "coio.h"
 #include "lpt.h"
 #endif
 
@@ -3586,7 +3587,7 @@ static int dos_fs_redirect(struct vm86_regs *state)
       }
       Debug0((dbg_fd, "Actual pos %u\n", (unsigned int)itisnow));
 
-      ret = dos_read(fd, dta, cnt);
+      ret = coio_dos_read(fd, dta, cnt);
 
       Debug0((dbg_fd, "Read returned : %d\n", ret));
       if (ret < 0) {
@@ -3646,7 +3647,7 @@ static int dos_fs_redirect(struct vm86_regs *state)
       Debug0((dbg_fd, "Handle cnt %d\n", sft_handle_cnt(sft)));
       Debug0((dbg_fd, "sft_size = %x, sft_pos = %x, dta = %#x, cnt = %x\n",
                       (int)sft_size(sft), (int)sft_position(sft), dta, (int)cnt));
-      ret = dos_write(fd, dta, cnt);
+      ret = coio_dos_write(fd, dta, cnt);
       if ((ret + s_pos) > sft_size(sft)) {
         sft_size(sft) = ret + s_pos;
         if (ret == 0) {
@@ -21,6 +21,7 @@
 #include "mangle.h"
 #include "utilities.h"
 #include "dos2linux.h"
+#include "cdimage.h"
 
 #define CALC_PTR(PTR,OFFSET,RESULT_TYPE) ((RESULT_TYPE *)(PTR+OFFSET))
 
@@ -195,6 +196,11 @@ static int GetDirectoryEntry(int drive, int copyFlag, Bit32u pathname,
 			searchName[searchlen - 1] = 0;
 
 	C_printf("MSCDEX: Get DirEntry : Find : %s\n", searchName);
+	// image files have an index, fall back to the walk on a miss
+	entryLength = cdrom_image_lookup(GetDriver(drive), searchName,
+					 defBuffer);
+	if ((int)entryLength > 0)
+		return fill_buffer(copyFlag, buffer, defBuffer, entryLength);
 	// read vtoc
 	err = ReadSectors(drive, 16, 1, defBuffer, 0);
 	if (err)
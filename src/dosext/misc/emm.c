@@ -186,8 +186,22 @@ static struct emm_record {
   u_short handle;
   u_short logical_page;
   u_short phys_seg;
+  u_char pending;		/* host mapping not yet updated */
 } emm_map[EMM_MAX_PHYS];
 
+/* Map requests only update emm_map. The host mappings are brought up
+ * to date by flush_pages(), which coalesces adjacent physical pages
+ * that map consecutive logical pages into one alias_mapping() call.
+ * Multi-page functions flush once at the end. */
+static int emm_batch;
+
+static struct {
+  unsigned long calls[0x100];	/* by function (AH) */
+  unsigned long maps;		/* page map requests */
+  unsigned long skipped;	/* ...for pages that were already mapped */
+  unsigned long host_maps;	/* alias_mapping() calls */
+} emm_stats;
+
 struct emm_reg {
   u_short handle;
   u_short logical_page;
@@ -454,6 +468,46 @@ static void _do_unmap_page(unsigned int base, int size)
 	PROT_READ | PROT_WRITE | PROT_EXEC, LOWMEM(base));
 }
 
+/* update the host mappings of pages changed since the last flush */
+static void flush_pages(void)
+{
+  int i, j;
+
+  for (i = 0; i < phys_pages; i = j) {
+    int handle = emm_map[i].handle;
+    int len;
+
+    j = i + 1;
+    if (!emm_map[i].pending)
+      continue;
+    while (j < phys_pages && emm_map[j].pending &&
+	PHYS_PAGE_SEGADDR(j) == PHYS_PAGE_SEGADDR(j - 1) + EMM_PAGE_SIZE / 16 &&
+	emm_map[j].handle == handle && (handle == NULL_HANDLE ||
+	emm_map[j].logical_page == emm_map[j - 1].logical_page + 1))
+      j++;
+    len = (j - i) * EMM_PAGE_SIZE;
+    if (handle == NULL_HANDLE)
+      _do_unmap_page(PHYS_PAGE_ADDR(i), len);
+    else
+      _do_map_page(PHYS_PAGE_ADDR(i), handle_info[handle].object +
+	  emm_map[i].logical_page * EMM_PAGE_SIZE, len);
+    emm_stats.host_maps++;
+    while (i < j)
+      emm_map[i++].pending = 0;
+  }
+}
+
+static void begin_batch(void)
+{
+  emm_batch++;
+}
+
+static void end_batch(void)
+{
+  if (--emm_batch == 0)
+    flush_pages();
+}
+
 static int
 __map_page(int physical_page)
 {
@@ -504,13 +558,16 @@ unmap_page(int physical_page)
 {
    E_printf("EMS: unmap_page(%d)\n",physical_page);
 
-   if (__unmap_page(physical_page)) {
-      emm_map[physical_page].handle = NULL_HANDLE;
-      emm_map[physical_page].logical_page = NULL_PAGE;
-      return (TRUE);
-   }
-   else
+   if ((physical_page < 0) || (physical_page >= phys_pages))
       return (FALSE);
+   if (emm_map[physical_page].handle == NULL_HANDLE)
+      return (FALSE);
+   emm_map[physical_page].handle = NULL_HANDLE;
+   emm_map[physical_page].logical_page = NULL_PAGE;
+   emm_map[physical_page].pending = 1;
+   if (!emm_batch)
+      flush_pages();
+   return (TRUE);
 }
 
 static inline int
@@ -523,9 +580,6 @@ reunmap_page(int physical_page)
 static int
 map_page(int handle, int physical_page, int logical_page)
 {
-  unsigned int base;
-  caddr_t logical;
-
   E_printf("EMS: map_page(handle=%d, phy_page=%d, log_page=%d), prev handle=%d\n",
            handle, physical_page, logical_page, emm_map[physical_page].handle);
 
@@ -537,19 +591,19 @@ map_page(int handle, int physical_page, int logical_page)
   if (handle_info[handle].numpages <= logical_page)
     return (FALSE);
 
-#if 0
-/* no need to unmap before mapping */
-  if (emm_map[physical_page].handle != NULL_HANDLE)
-    unmap_page(physical_page);
-#endif
-
-  base = PHYS_PAGE_ADDR(physical_page);
-  logical = handle_info[handle].object + logical_page * EMM_PAGE_SIZE;
-
-  _do_map_page(base, logical, EMM_PAGE_SIZE);
+  emm_stats.maps++;
+  /* bank switching often re-selects the page that is already there */
+  if (emm_map[physical_page].handle == handle &&
+      emm_map[physical_page].logical_page == logical_page) {
+    emm_stats.skipped++;
+    return (TRUE);
+  }
 
   emm_map[physical_page].handle = handle;
   emm_map[physical_page].logical_page = logical_page;
+  emm_map[physical_page].pending = 1;
+  if (!emm_batch)
+    flush_pages();
   return (TRUE);
 }
 
@@ -590,6 +644,7 @@ int emm_restore_handle_state(int handle)
 {
   int i;
 
+  begin_batch();
   for (i = 0; i < saved_phys_pages; i++) {
     int saved_mapping;
     int saved_mapping_handle;
@@ -605,6 +660,7 @@ int emm_restore_handle_state(int handle)
       unmap_page(i);
     }
   }
+  end_batch();
   return 0;
 }
 
@@ -697,6 +753,7 @@ static void emm_set_partial_map_registers(const void *ptr)
 
   pages = *buf;
   buf2 = ptr + sizeof(*buf);
+  begin_batch();
   for (i = 0; i < pages; i++) {
     uint16_t handle = buf2[i].handle;
     uint16_t logical_page = buf2[i].logical_page;
@@ -709,6 +766,7 @@ static void emm_set_partial_map_registers(const void *ptr)
     Kdebug1((dbg_fd, "phy %d h %x lp %d\n",
 	    phy, handle, logical_page));
   }
+  end_batch();
 }
 
 static int emm_get_size_for_partial_page_map(int pages)
@@ -755,6 +813,7 @@ int emm_map_unmap_multi(const u_short *array, int handle, int map_len)
 {
   int ret = EMM_NO_ERR;
   int i, phys, log;
+  begin_batch();
   for (i = 0; i < map_len; i++) {
     log = array[i * 2];
     phys = array[i * 2 + 1];
@@ -763,6 +822,7 @@ int emm_map_unmap_multi(const u_short *array, int handle, int map_len)
     if (ret != EMM_NO_ERR)
       break;
   }
+  end_batch();
   return ret;
 }
 
@@ -1645,6 +1705,7 @@ static void set_map_registers(const struct emm_reg *buf, int pages)
   int handle;
   int logical_page;
 
+  begin_batch();
   for (i = 0; i < pages; i++) {
     handle = buf[i].handle;
     logical_page = buf[i].logical_page;
@@ -1656,6 +1717,7 @@ static void set_map_registers(const struct emm_reg *buf, int pages)
     Kdebug1((dbg_fd, "phy %d h %x lp %d\n",
 	    i, handle, logical_page));
   }
+  end_batch();
 }
 
 static void emm_set_map_registers(char *ptr)
@@ -1856,6 +1918,7 @@ os_set_function(struct vm86_regs * state)
 int
 ems_fn(struct vm86_regs *state)
 {
+  emm_stats.calls[HI_BYTE_d(state->eax)]++;
   switch (HI_BYTE_d(state->eax)) {
   case GET_MANAGER_STATUS:{	/* 0x40 */
       Kdebug1((dbg_fd, "bios_emm: Get Manager Status\n"));
@@ -2321,6 +2384,21 @@ void ems_init(void)
   EMSAPMAP_ret_OFF = hlt_register_handler(hlt_hdlr);
 }
 
+void ems_done(void)
+{
+  int i;
+
+  if (!emm_stats.maps)
+    return;
+  E_printf("EMS: %lu page maps, %lu already mapped, %lu host remaps\n",
+	emm_stats.maps, emm_stats.skipped, emm_stats.host_maps);
+  for (i = 0; i < 0x100; i++) {
+    if (emm_stats.calls[i])
+      E_printf("EMS: function 0x%02x called %lu times\n", i,
+	    emm_stats.calls[i]);
+  }
+}
+
 int emm_is_pframe_addr(dosaddr_t addr, uint32_t *size)
 {
   int i;
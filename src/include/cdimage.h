@@ -0,0 +1,36 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CDIMAGE_H
+#define CDIMAGE_H
+
+/* ISO9660 image files used as CD-ROM media */
+
+struct cd_image;
+
+struct cd_image *cdimg_open(const char *path);
+void cdimg_close(struct cd_image *ci);
+int cdimg_read(struct cd_image *ci, unsigned char *buf, unsigned dosbuf,
+	unsigned sector, unsigned count);
+unsigned cdimg_num_sectors(const struct cd_image *ci);
+int cdimg_changed(const struct cd_image *ci);
+int cdimg_lookup(struct cd_image *ci, const char *path,
+	unsigned char *rec);
+
+/* mscdex helper: look up a path on the image of a CD-ROM unit */
+int cdrom_image_lookup(int unit, const char *path, unsigned char *rec);
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef COIO_H
+#define COIO_H
+
+#include <stddef.h>
+
+/* Blocking host I/O offloaded to worker threads */
+
+typedef void (*coio_func_t)(void *arg);
+
+void *coio_alloc(size_t size);
+void coio_free(void *arg);
+void coio_run(coio_func_t func, void *arg);
+
+int coio_dos_read(int fd, unsigned data, int cnt);
+int coio_dos_write(int fd, unsigned data, int cnt);
+
+#endif
@@ -33,11 +33,13 @@ int coopth_unsafe_detach(int tid, const char *who);
 void coopth_unsafe_shutdown(void);
 int coopth_set_sleep_handler(coopth_func_t func, void *arg);
 int coopth_set_cleanup_handler(coopth_func_t func, void *arg);
+int coopth_get_cleanup_handler(coopth_func_t *func, void **arg);
 void coopth_push_user_data(int tid, void *udata);
 void coopth_push_user_data_cur(void *udata);
 void *coopth_pop_user_data(int tid);
 void *coopth_pop_user_data_cur(void);
 int coopth_get_tid(void);
+int coopth_is_in_thread(void);
 void coopth_ensure_sleeping(int tid);
 void coopth_ensure_single(int tid);
 void coopth_yield(void);
@@ -0,0 +1,42 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include "types.h"
+
+/* deadline-ordered timer events, all driven by a single host timer.
+ * Main thread only. */
+
+typedef void (*deadline_func_t)(void *arg);
+
+int deadline_register(deadline_func_t func, void *arg, const char *name);
+/* one-shot, 'when' is in GETusTIME() units */
+void deadline_set(int id, hitimer_t when);
+/* periodic, in usecs of host time. When the guest sleeps and idle()
+ * (if any) agrees, the period stretches to idle_period */
+void deadline_set_periodic(int id, unsigned period, unsigned idle_period,
+	int (*idle)(void *arg));
+void deadline_cancel(int id);
+void deadline_kick(void);
+void deadline_sleep(int on);
+void deadline_block(int on);
+void deadline_start(void);
+void deadline_run(void);
+void deadline_done(void);
+
+#endif
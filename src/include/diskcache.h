@@ -0,0 +1,55 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Block cache for disk images: LRU, write-through or write-back,
+ * sequential readahead */
+
+#define DCACHE_BLK_SHIFT	12
+#define DCACHE_BLK_SIZE		(1 << DCACHE_BLK_SHIFT)
+
+struct dcache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t ra_blocks;		/* blocks fetched by readahead */
+  uint64_t ra_hits;		/* ... and later used */
+  uint64_t preads;
+  uint64_t pwrites;
+  uint64_t writebacks;		/* dirty blocks written to the file */
+};
+
+struct disk_cache;
+
+/* backing store accessors, with preadv()/pwritev() semantics */
+typedef ssize_t (*dcache_io_t)(void *arg, const struct iovec *iov, int iovcnt,
+    off_t pos);
+
+struct disk_cache *dcache_create(dcache_io_t rd, dcache_io_t wr, void *arg,
+    int nblocks, int writeback);
+void dcache_destroy(struct disk_cache *dc);
+ssize_t dcache_pread(struct disk_cache *dc, void *buf, size_t len, off_t pos);
+ssize_t dcache_pwrite(struct disk_cache *dc, const void *buf, size_t len,
+    off_t pos);
+int dcache_flush(struct disk_cache *dc);
+void dcache_get_stats(const struct disk_cache *dc, struct dcache_stats *st);
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DISKOVL_H
+#define DISKOVL_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Copy-on-write overlay on top of a read-only base image */
+
+enum { DOVL_NONE, DOVL_KEEP, DOVL_DISCARD, DOVL_COMMIT };
+
+struct disk_overlay;
+
+struct disk_overlay *dovl_open(const char *path, int base_fd, int mode);
+void dovl_close(struct disk_overlay *ov);
+ssize_t dovl_pread(struct disk_overlay *ov, void *buf, size_t len, off_t pos);
+ssize_t dovl_pwrite(struct disk_overlay *ov, const void *buf, size_t len,
+    off_t pos);
+ssize_t dovl_preadv(void *arg, const struct iovec *iov, int iovcnt,
+    off_t pos);
+ssize_t dovl_pwritev(void *arg, const struct iovec *iov, int iovcnt,
+    off_t pos);
+int dovl_sync(struct disk_overlay *ov);
+int dovl_parse_mode(const char *s);
+
+#endif
@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 /* disk file types */
 typedef enum {
@@ -119,6 +120,14 @@ struct disk {
   int timeout;			/* seconds between floppy timeouts */
   struct partition part_info;	/* neato partition info */
   fatfs_t *fatfs;		/* for FAT file system emulation */
+  struct disk_cache *dcache;	/* block cache, NULL if disabled */
+  char *ovl_name;		/* copy-on-write overlay file */
+  int ovl_mode;			/* DOVL_xxx */
+  struct disk_overlay *ovl;
+  unsigned char *map;		/* mmap()ed image, NULL if not mapped */
+  size_t map_size;
+  volatile int map_lost;	/* truncated under us, see disk_mmap_fault() */
+  pthread_mutex_t io_mtx;	/* held by the I/O worker during transfers */
 };
 
 /* NOTE: the "header" element in the structure above can (and will) be
@@ -195,10 +204,11 @@ extern struct disk *hdisk_find_by_path(const char *path);
 #endif
 
 int read_mbr(const struct disk *dp, unsigned buffer);
-int read_sectors(const struct disk *, unsigned, uint64_t, long);
+int read_sectors(struct disk *, unsigned, uint64_t, long);
 int write_sectors(struct disk *, unsigned, uint64_t, long);
 
 void disk_open(struct disk *dp);
+int disk_mmap_fault(void *addr);
 int disk_is_bootable(const struct disk *dp);
 int disk_root_contains(const struct disk *dp, int file_idx);
 int disk_validate_boot_part(struct disk *dp);
@@ -234,6 +234,9 @@ typedef struct config_info {
        boolean vbios_post;
 
        int  fastfloppy;
+       int  disk_cache;		/* hdisk block cache size in Kbytes */
+       boolean disk_cache_wb;	/* defer cached writes until a flush */
+       int  disk_mmap;		/* max size of mmap()ed images in Kbytes */
        char *emusys;		/* map CONFIG.SYS to CONFIG.EMU */
 
        u_short speaker;		/* 0 off, 1 native, 2 emulated */
@@ -257,6 +260,7 @@ typedef struct config_info {
        int dpmi, pm_dos_api, no_null_checks;
        uint32_t dpmi_lin_rsv_base;
        uint32_t dpmi_lin_rsv_size;
+       int hugepages;		/* THP for the DPMI pool and ext mem */
 
        int sillyint;            /* IRQ numbers for Silly Interrupt Generator
        				   (bitmask, bit3..15 ==> IRQ3 .. IRQ15) */
@@ -31,12 +31,14 @@ typedef struct {
   Bit16u         write_latch;
   Bit32s         cntr;
   hitimer_u	 time;
+  Bit8u          restart;
 } pit_latch_struct;
 
 extern pit_latch_struct pit[PIT_TIMERS];
 
 extern void  pit_init(void);
 extern void  pit_reset(void);
+extern void  pit_done(void);
 
 /*******************************************************************
  * Real Time Clock (RTC) chip                                      *
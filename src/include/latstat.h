@@ -0,0 +1,38 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LATSTAT_H
+#define LATSTAT_H
+
+/* latency histogram: exact up to 8us, then 8 buckets per power of 2,
+ * so percentiles are within 12.5% */
+
+#define LAT_SUB_BITS 3
+#define LAT_BUCKETS ((32 - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+struct lat_stat {
+  unsigned long long count;
+  unsigned long long sum;
+  unsigned max;
+  unsigned hist[LAT_BUCKETS];
+};
+
+void lat_add(struct lat_stat *ls, unsigned val);
+unsigned lat_percentile(const struct lat_stat *ls, int pct);
+unsigned lat_mean(const struct lat_stat *ls);
+void lat_reset(struct lat_stat *ls);
+
+#endif
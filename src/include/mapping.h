@@ -101,6 +101,7 @@ extern int have_mremap_fixed;
 
 void mapping_init(void);
 void mapping_close(void);
+void mapping_huge_coverage(const char *name, void *addr, size_t size);
 
 void init_hardware_ram(void);
 int map_hardware_ram(char type);
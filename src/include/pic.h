@@ -97,6 +97,7 @@ int pic_pending(void);			/* inform caller if interrupt is pending */
 int pic_irq_active(int num);
 int pic_irq_masked(int num);
 void pic_sched(int ilevel, int interval);          /* schedule an interrupt */
+void pic_resched(int ilevel, hitimer_t start, int interval);
 /* The following are too simple to be anything but in-line */
 
 #define pic_set_mask pic_imr=(pic0_imr|pic1_imr|pic_iflag)
@@ -104,6 +105,9 @@ void pic_sched(int ilevel, int interval);          /* schedule an interrupt */
 int CAN_SLEEP(void);
 
 extern void pic_reset(void);
+extern void pic_done(void);
+extern void pic_reset_stats(void);
+extern void pic_print_stats(void (*printf)(const char *, ...));
 extern void pic_init(void);
 
 #endif	/* PIC_H */
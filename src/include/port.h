@@ -38,6 +38,16 @@ typedef struct {
   int           irq, fd;
 } emu_iodev_t;
 
+/* optional bulk handlers for REP INS/OUTS, called for DF=0 only */
+typedef struct {
+  void (*rep_inb)  (ioport_t port, Bit8u *dest, Bit32u count);
+  void (*rep_outb) (ioport_t port, const Bit8u *src, Bit32u count);
+  void (*rep_inw)  (ioport_t port, Bit16u *dest, Bit32u count);
+  void (*rep_outw) (ioport_t port, const Bit16u *src, Bit32u count);
+  void (*rep_ind)  (ioport_t port, Bit32u *dest, Bit32u count);
+  void (*rep_outd) (ioport_t port, const Bit32u *src, Bit32u count);
+} emu_iodev_rep_t;
+
 typedef struct {
   Bit8u  (*read_portb)  (ioport_t port_addr);
   void   (*write_portb) (ioport_t port_addr, Bit8u byte);
@@ -45,6 +55,7 @@ typedef struct {
   void   (*write_portw) (ioport_t port_addr, Bit16u word);
   Bit32u (*read_portd) (ioport_t port_addr);
   void   (*write_portd) (ioport_t port_addr, Bit32u dword);
+  emu_iodev_rep_t rep;
   const char *handler_name;
   int    irq, fd;
 } _port_handler;
@@ -184,6 +195,8 @@ extern unsigned char port_ormask[];
 
 extern int     port_init(void);
 extern int     port_register_handler(emu_iodev_t info, int);
+extern int     port_register_rep_handler(ioport_t port,
+			const emu_iodev_rep_t *rep);
 extern Boolean port_allow_io(ioport_t, Bit16u, int, Bit8u, Bit8u, int, char *);
 extern int     set_ioperm(int start, int size, int flag);
 
@@ -42,6 +42,19 @@ ssize_t rng_get_free_space(struct rng_s *rng);
 void rng_clear(struct rng_s *rng);
 void rng_allow_ovw(struct rng_s *rng, int on);
 
+/* single producer, single consumer, lock-free */
+struct spsc_s {
+  unsigned char *buffer;
+  unsigned int objnum, objsize;
+  unsigned int head, tail;
+};
+void spsc_init(struct spsc_s *rng, size_t objnum, size_t objsize);
+void spsc_destroy(struct spsc_s *rng);
+int spsc_put(struct spsc_s *rng, const void *obj);
+int spsc_peek(struct spsc_s *rng, void *buf);
+int spsc_get(struct spsc_s *rng, void *buf);
+int spsc_count(struct spsc_s *rng);
+
 
 struct seqitem {
     size_t len, waste;
@@ -76,6 +76,7 @@ extern int sigchld_register_handler(pid_t pid, void (*handler)(void));
 extern int sigchld_enable_cleanup(pid_t pid);
 extern int sigchld_enable_handler(pid_t pid, int on);
 extern int sigalrm_register_handler(void (*handler)(void));
+extern void signal_start_tick(int period);
 extern void registersig(int sig, void (*handler)(sigcontext_t *,
 	siginfo_t *));
 extern void registersig_std(int sig, void (*handler)(void *));
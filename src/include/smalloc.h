@@ -18,12 +18,21 @@ struct memnode {
   size_t size;
   int used;
   unsigned char *mem_area;
+  /* address-ordered tree of all memnodes */
+  struct memnode *left, *right, *parent;
+  size_t max_free;		/* largest free area in this subtree */
+  unsigned prio;
 };
 
+/* uncommitted space is given back zero-filled on commit */
+#define SM_ZEROED_COMMIT 1
+
 typedef struct mempool {
   size_t size;
   size_t avail;
   struct memnode mn;
+  struct memnode *root;
+  int flags;
   int (*commit)(void *area, size_t size);
   int (*uncommit)(void *area, size_t size);
   void (*smerr)(int prio, const char *fmt, ...) FORMAT(printf, 2, 3);
@@ -37,6 +46,7 @@ extern int sminit(struct mempool *mp, void *start, size_t size);
 extern int sminit_com(struct mempool *mp, void *start, size_t size,
     int (*commit)(void *area, size_t size),
     int (*uncommit)(void *area, size_t size));
+extern void smset_flags(struct mempool *mp, int flags);
 extern void smfree_all(struct mempool *mp);
 extern int smdestroy(struct mempool *mp);
 extern size_t smget_free_space(struct mempool *mp);
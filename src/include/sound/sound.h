@@ -122,8 +122,9 @@ struct pcm_recorder {
   void *id2;
 };
 
-typedef int (*efp_process)(int handle, sndbuf_t buf[][SNDBUF_CHANS],
-	int nframes, int channels, int format, int srate);
+/* effects work in place on planar float blocks, range -1.0 to 1.0 */
+typedef int (*efp_process)(int handle, float *buf[SNDBUF_CHANS],
+	int nframes, int channels, int srate);
 
 #ifdef __cplusplus
 struct pcm_efp : public pcm_base {
@@ -202,6 +203,7 @@ extern void pcm_write_interleaved(sndbuf_t ptr[][SNDBUF_CHANS],
 	int frames, int rate, int format, int nchans, int strm_idx);
 extern int pcm_format_size(int format);
 extern void pcm_timer(void);
+extern int pcm_playing(void);
 extern void pcm_prepare_stream(int strm_idx);
 extern double pcm_time_lock(int strm_idx);
 extern void pcm_time_unlock(int strm_idx);
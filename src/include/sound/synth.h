@@ -0,0 +1,29 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef SOUND_SYNTH_H
+#define SOUND_SYNTH_H
+
+/* Sound generators (adlib, software MIDI synths) share one worker
+ * thread. run() is called from that thread with the common deadline
+ * and renders whatever is due up to it. */
+typedef void (*synth_run_t)(void *arg, long long now);
+
+extern int synth_register(synth_run_t run, void *arg, const char *name);
+extern void synth_unregister(synth_run_t run, void *arg);
+extern void synth_timer(void);
+
+#endif
@@ -134,6 +134,8 @@ extern int dosemu_user_froze;
 extern Bit8u pit_control_inp(ioport_t);
 extern void pit_control_outp(ioport_t port, Bit8u val);
 extern void initialize_timers(void);
+extern void pit_reset_stats(void);
+extern void pit_print_stats(void (*printf)(const char *, ...));
 extern void get_time_init(void);
 extern void cputime_late_init(void);
 extern void do_sound(Bit16u period);
@@ -218,6 +218,10 @@ static COMMAND cmds[] = {
    "ADDR              display the Device Driver Request Header at ADDR\n"},
   {"dpbs", NULL,
    "[ADDR]            display DPBs by walking the chain from LOL or ADDR\n"},
+  {"timer", NULL,
+   "[reset]           show or reset IRQ0 latency and jitter statistics\n"},
+  {"pic", NULL,
+   "[reset]           show or reset per-IRQ delivery latency statistics\n"},
   {"kill", db_kill,
    "                  Kill the dosemu process\n"},
   {"quit", db_quit,
@@ -49,6 +49,7 @@
 #include "emu.h"
 #include "cpu.h"
 #include "timers.h"
+#include "pic.h"
 #include "dpmi.h"
 #include "int.h"
 #include "hlt.h"
@@ -100,6 +101,8 @@ static void mhp_ddrh    (int, char *[]);
 static void mhp_dpbs    (int, char *[]);
 static void mhp_bplog   (int, char *[]);
 static void mhp_bclog   (int, char *[]);
+static void mhp_timer   (int, char *[]);
+static void mhp_pic     (int, char *[]);
 static void print_log_breakpoints(void);
 
 /* static data */
@@ -158,6 +161,8 @@ static const struct cmd_db cmdtab[] = {
    {"devs",          mhp_devs},
    {"ddrh",          mhp_ddrh},
    {"dpbs",          mhp_dpbs},
+   {"timer",         mhp_timer},
+   {"pic",           mhp_pic},
    {"",              NULL}
 };
 
@@ -1281,6 +1286,26 @@ static void mhp_mcbs(int argc, char *argv[])
   }
 }
 
+static void mhp_timer(int argc, char *argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+    pit_reset_stats();
+    mhp_printf("timer statistics reset\n");
+    return;
+  }
+  pit_print_stats(mhp_printf);
+}
+
+static void mhp_pic(int argc, char *argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+    pic_reset_stats();
+    mhp_printf("PIC statistics reset\n");
+    return;
+  }
+  pic_print_stats(mhp_printf);
+}
+
 static void mhp_devs(int argc, char *argv[])
 {
   struct DDH *dev;
@@ -31,14 +31,15 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include <fluidsynth.h>
 #include "seqbind.h"
 #include "emu.h"
 #include "init.h"
+#include "ringbuf.h"
 #include "timers.h"
 #include "sound/midi.h"
 #include "sound/sound.h"
+#include "sound/synth.h"
 
 
 #define midoflus_name "flus"
@@ -54,14 +55,34 @@ static fluid_synth_t* synth;
 static fluid_sequencer_t* sequencer;
 static void *synthSeqID;
 static int pcm_stream;
-static int output_running, pcm_running;
+static int output_running, synth_running, pcm_running;
+static int start_pending;
 static double mf_time_base;
 static double flus_srate;
 
-static pthread_t syn_thr;
-static sem_t syn_sem;
 static pthread_mutex_t syn_mtx = PTHREAD_MUTEX_INITIALIZER;
-static void *synth_thread(void *arg);
+
+/* MIDI bytes go from the port writes to the synth thread through a
+ * lock-free queue, with the time they were written. The synth thread
+ * feeds them in at the right sample of the block it renders. The
+ * writer never takes syn_mtx, which is held for a whole render. If the
+ * queue is full, it keeps the bytes in its own spill buffer and moves
+ * them to the queue on the next write or sound tick. Only when that is
+ * full too are bytes dropped. */
+struct flus_ev {
+    long long time;
+    unsigned char data;
+};
+#define FLUS_EVQ_SIZE 8192
+#define FLUS_SPILL_SIZE 4096
+static struct spsc_s ev_queue;
+/* only touched by the writer, i.e. the CPU thread */
+static struct flus_ev ev_spill[FLUS_SPILL_SIZE];
+static int spill_head, spill_len;
+static int ev_dropped;
+static void midoflus_synth_run(void *arg, long long now);
+static void mf_send_event(const struct flus_ev *ev);
+static void mf_drain_queue(void);
 
 static int midoflus_init(void *arg)
 {
@@ -115,14 +136,11 @@ static int midoflus_init(void *arg)
     fluid_settings_setstr(settings, "synth.midi-bank-select", "gm");
     sequencer = new_fluid_sequencer2(0);
     synthSeqID = fluid_sequencer_register_fluidsynth2(sequencer, synth);
+    spsc_init(&ev_queue, FLUS_EVQ_SIZE, sizeof(struct flus_ev));
 
-    sem_init(&syn_sem, 0, 0);
-    pthread_create(&syn_thr, NULL, synth_thread, NULL);
-#if defined(HAVE_PTHREAD_SETNAME_NP) && defined(__GLIBC__)
-    pthread_setname_np(syn_thr, "dosemu: fluid");
-#endif
     pcm_stream = pcm_allocate_stream(FLUS_CHANNELS, "MIDI",
 	    (void*)MC_MIDI);
+    synth_register(midoflus_synth_run, NULL, "fluidsynth");
 
     return 1;
 
@@ -135,10 +153,9 @@ err1:
 
 static void midoflus_done(void *arg)
 {
-    pthread_cancel(syn_thr);
-    pthread_join(syn_thr, NULL);
-    sem_destroy(&syn_sem);
+    synth_unregister(midoflus_synth_run, NULL);
 
+    spsc_destroy(&ev_queue);
     delete_fluid_sequencer(sequencer);
     delete_fluid_synth(synth);
     delete_fluid_settings(settings);
@@ -148,36 +165,121 @@ static void midoflus_start(void)
 {
     S_printf("MIDI: starting fluidsynth\n");
     mf_time_base = GETusTIME(0);
-    pthread_mutex_lock(&syn_mtx);
+    output_running = 1;
+    /* the synth thread prepares the stream on its next pass */
+    __atomic_store_n(&start_pending, 1, __ATOMIC_RELEASE);
+}
+
+/* called with syn_mtx held */
+static void mf_start_synth(void)
+{
     pcm_prepare_stream(pcm_stream);
     fluid_sequencer_process(sequencer, 0);
-    output_running = 1;
-    pthread_mutex_unlock(&syn_mtx);
+    synth_running = 1;
+}
+
+static void mf_flush_spill(void)
+{
+    while (spill_len && spsc_put(&ev_queue, &ev_spill[spill_head])) {
+	spill_head = (spill_head + 1) % FLUS_SPILL_SIZE;
+	spill_len--;
+    }
 }
 
 static void midoflus_write(unsigned char val)
 {
-    int ret;
-    unsigned long long now = GETusTIME(0);
-    int msec = (now - mf_time_base) / 1000;
+    struct flus_ev ev;
 
     if (!output_running)
 	midoflus_start();
 
-    fluid_sequencer_process(sequencer, msec);
+    ev.time = GETusTIME(0);
+    ev.data = val;
+    /* spilled bytes go first, to keep the order */
+    mf_flush_spill();
+    if (!spill_len && spsc_put(&ev_queue, &ev))
+	return;
+    if (spill_len == FLUS_SPILL_SIZE) {
+	ev_dropped++;
+	return;
+    }
+    ev_spill[(spill_head + spill_len) % FLUS_SPILL_SIZE] = ev;
+    spill_len++;
+}
+
+static void midoflus_run(void)
+{
+    mf_flush_spill();
+    if (ev_dropped) {
+	S_printf("MIDI: fluidsynth queue overflow, dropped %i bytes\n",
+		ev_dropped);
+	ev_dropped = 0;
+    }
+}
+
+/* called with syn_mtx held, which makes us the only consumer */
+static void mf_send_event(const struct flus_ev *ev)
+{
+    int ret;
+    unsigned char val = ev->data;
+
     ret = fluid_sequencer_add_midi_data_to_buffer(synthSeqID, &val, 1);
     if (ret != FLUID_OK)
 	S_printf("MIDI: failed sending midi event\n");
+    fluid_sequencer_process(sequencer, (ev->time - mf_time_base) / 1000);
+}
+
+/* called with syn_mtx held, from the CPU thread or the synth thread */
+static void mf_drain_queue(void)
+{
+    struct flus_ev ev;
+
+    while (spsc_peek(&ev_queue, &ev)) {
+	mf_send_event(&ev);
+	spsc_get(&ev_queue, NULL);
+    }
+}
+
+/* called with syn_mtx held, from the CPU thread */
+static void mf_drain_spill(void)
+{
+    while (spill_len) {
+	mf_send_event(&ev_spill[spill_head]);
+	spill_head = (spill_head + 1) % FLUS_SPILL_SIZE;
+	spill_len--;
+    }
 }
 
-static void mf_process_samples(int nframes)
+static void mf_process_samples(int nframes, double time_beg)
 {
     sndbuf_t buf[FLUS_MAX_BUF][FLUS_CHANNELS];
-    int ret;
-    ret = fluid_synth_write_s16(synth, nframes, buf, 0, 2, buf, 1, 2);
-    if (ret != FLUID_OK) {
-	error("MIDI: fluidsynth failed\n");
-	return;
+    struct flus_ev ev;
+    double period = pcm_frame_period_us(flus_srate);
+    int ret, done = 0;
+
+    while (done < nframes) {
+	int pos = nframes;
+
+	if (spsc_peek(&ev_queue, &ev)) {
+	    pos = (ev.time - time_beg) / period;
+	    if (pos < done)
+		pos = done;
+	}
+	if (pos > nframes)
+	    pos = nframes;
+	if (pos > done) {
+	    ret = fluid_synth_write_s16(synth, pos - done, buf[done], 0, 2,
+		    buf[done], 1, 2);
+	    if (ret != FLUID_OK) {
+		error("MIDI: fluidsynth failed\n");
+		return;
+	    }
+	    done = pos;
+	}
+	if (done < nframes) {
+	    mf_send_event(&ev);
+	    spsc_get(&ev_queue, NULL);
+	}
     }
     pcm_running = 1;
     pcm_write_interleaved(buf, nframes, flus_srate, flus_format,
@@ -198,7 +300,7 @@ static void process_samples(long long now, int min_buf)
 	    retry = 1;
 	}
 	if (nframes >= min_buf) {
-	    mf_process_samples(nframes);
+	    mf_process_samples(nframes, mf_time_cur);
 	    mf_time_cur = pcm_get_stream_time(pcm_stream);
 	    if (debug_level('S') >= 5)
 		S_printf("MIDI: processed %i samples with fluidsynth\n", nframes);
@@ -211,11 +313,14 @@ static void midoflus_stop(void *arg)
 {
     long long now;
     int msec;
-    pthread_mutex_lock(&syn_mtx);
-    if (!output_running) {
-	pthread_mutex_unlock(&syn_mtx);
+    if (!output_running)
 	return;
-    }
+    pthread_mutex_lock(&syn_mtx);
+    /* the synth thread may not have seen the start yet */
+    __atomic_store_n(&start_pending, 0, __ATOMIC_RELAXED);
+    /* deliver what is still queued, so the parser state stays sane */
+    mf_drain_queue();
+    mf_drain_spill();
     now = GETusTIME(0);
     msec = (now - mf_time_base) / 1000;
     S_printf("MIDI: stopping fluidsynth at msec=%i\n", msec);
@@ -226,32 +331,19 @@ static void midoflus_stop(void *arg)
     if (pcm_running)
 	pcm_flush(pcm_stream);
     pcm_running = 0;
+    synth_running = 0;
     output_running = 0;
     pthread_mutex_unlock(&syn_mtx);
 }
 
-static void *synth_thread(void *arg)
+static void midoflus_synth_run(void *arg, long long now)
 {
-    while (1) {
-	sem_wait(&syn_sem);
-	pthread_mutex_lock(&syn_mtx);
-	if (!output_running) {
-		pthread_mutex_unlock(&syn_mtx);
-		continue;
-	}
-	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-	process_samples(GETusTIME(0), FLUS_MIN_BUF);
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-	pthread_mutex_unlock(&syn_mtx);
-    }
-    return NULL;
-}
-
-static void midoflus_run(void)
-{
-    if (!output_running)
-	return;
-    sem_post(&syn_sem);
+    pthread_mutex_lock(&syn_mtx);
+    if (__atomic_exchange_n(&start_pending, 0, __ATOMIC_ACQUIRE))
+	mf_start_synth();
+    if (synth_running)
+	process_samples(now, FLUS_MIN_BUF);
+    pthread_mutex_unlock(&syn_mtx);
 }
 
 static int midoflus_cfg(void *arg)
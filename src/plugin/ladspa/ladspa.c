@@ -28,7 +28,6 @@
 #include <assert.h>
 #include <dlfcn.h>
 #include <string.h>
-#include <math.h>
 #include <ladspa.h>
 #include "utils.h"
 #include "emu.h"
@@ -207,71 +206,25 @@ static int ladspa_cfg(void *arg)
     return 0;
 }
 
-#define UC2F(v) ((*(unsigned char *)(v) - 128) / 128.0)
-#define SC2F(v) ((*(signed char *)(v)) / 128.0)
-#define US2F(v) ((*(unsigned short *)(v) - 32768) / 32768.0)
-#define SS2F(v) ((*(signed short *)(v)) / 32768.0)
-#define F2UC(v) ((unsigned char)(lrintf((v) * 127) + 128))
-#define F2SC(v) ((signed char)(lrintf((v) * 127)))
-#define F2US(v) ((unsigned short)(lrintf((v) * 32767) + 32768))
-#define F2SS(v) ((signed short)(lrintf((v) * 32767)))
-
-static float sample_to_float(void *data, int format)
-{
-    switch (format) {
-    case PCM_FORMAT_U8:
-	return UC2F(data);
-    case PCM_FORMAT_S8:
-	return SC2F(data);
-    case PCM_FORMAT_U16_LE:
-	return US2F(data);
-    case PCM_FORMAT_S16_LE:
-	return SS2F(data);
-    default:
-	error("PCM: format %i is not supported\n", format);
-	return 0;
-    }
-}
-
-static void float_to_sample(float sample, sndbuf_t *buf, int format)
-{
-    switch (format) {
-    case PCM_FORMAT_U8:
-	*buf = F2UC(sample);
-	break;
-    case PCM_FORMAT_S8:
-	*buf = F2SC(sample);
-	break;
-    case PCM_FORMAT_U16_LE:
-	*buf = F2US(sample);
-	break;
-    case PCM_FORMAT_S16_LE:
-	*buf = F2SS(sample);
-	break;
-    default:
-	error("PCM: format1 %i is not supported\n", format);
-    }
-}
-
-static int ladspa_process(int h, sndbuf_t buf[][SNDBUF_CHANS],
-	int nframes, int channels, int format, int srate)
+static int ladspa_process(int h, float *buf[SNDBUF_CHANS],
+	int nframes, int channels, int srate)
 {
     struct la_h *lah = &handles[h];
     struct lads *lad = lah->lad;
-    LADSPA_Data tmp_in[nframes], tmp_out[nframes];
-    int i, j;
+    int inplace = !LADSPA_IS_INPLACE_BROKEN(lad->descriptor->Properties);
+    LADSPA_Data tmp_out[inplace ? 1 : nframes];
+    int i;
     if (srate != lah->srate) {
 	error("ladspa: wrong sampling rate\n");
 	return 0;
     }
     for (i = 0; i < channels; i++) {
-	lad->descriptor->connect_port(lah->handle[i], lad->in, tmp_in);
-	lad->descriptor->connect_port(lah->handle[i], lad->out, tmp_out);
-	for (j = 0; j < nframes; j++)
-	    tmp_in[j] = sample_to_float(&buf[j][i], format);
+	lad->descriptor->connect_port(lah->handle[i], lad->in, buf[i]);
+	lad->descriptor->connect_port(lah->handle[i], lad->out,
+		inplace ? buf[i] : tmp_out);
 	lad->descriptor->run(lah->handle[i], nframes);
-	for (j = 0; j < nframes; j++)
-	    float_to_sample(tmp_out[j], &buf[j][i], format);
+	if (!inplace)
+	    memcpy(buf[i], tmp_out, nframes * sizeof(LADSPA_Data));
     }
     return nframes;
 }
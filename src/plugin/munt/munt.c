@@ -22,7 +22,6 @@
  */
 
 #include <pthread.h>
-#include <semaphore.h>
 #include <string.h>
 #include <limits.h>
 #include <mt32emu/c_interface/c_interface.h>
@@ -31,6 +30,7 @@
 #include "timers.h"
 #include "sound/midi.h"
 #include "sound/sound.h"
+#include "sound/synth.h"
 
 #define midomunt_name "munt"
 #define midomunt_longname "MIDI Output: munt device"
@@ -45,10 +45,8 @@ static double mf_time_base;
 static const int munt_format = PCM_FORMAT_S16_LE;
 static int munt_srate;
 
-static pthread_t syn_thr;
-static sem_t syn_sem;
 static pthread_mutex_t syn_mtx = PTHREAD_MUTEX_INITIALIZER;
-static void *synth_thread(void *arg);
+static void midomunt_synth_run(void *arg, long long now);
 
 static int midomunt_init(void *arg)
 {
@@ -71,13 +69,9 @@ static int midomunt_init(void *arg)
 	goto err;
     }
 
-    sem_init(&syn_sem, 0, 0);
-    pthread_create(&syn_thr, NULL, synth_thread, NULL);
-#if defined(HAVE_PTHREAD_SETNAME_NP) && defined(__GLIBC__)
-    pthread_setname_np(syn_thr, "dosemu: munt");
-#endif
     pcm_stream = pcm_allocate_stream(MUNT_CHANNELS, "MIDI-MT32",
 	    (void*)MC_MIDI);
+    synth_register(midomunt_synth_run, NULL, "munt");
 
     return 1;
 
@@ -88,9 +82,7 @@ err:
 
 static void midomunt_done(void *arg)
 {
-    pthread_cancel(syn_thr);
-    pthread_join(syn_thr, NULL);
-    sem_destroy(&syn_sem);
+    synth_unregister(midomunt_synth_run, NULL);
     mt32emu_free_context(ctx);
 }
 
@@ -173,28 +165,12 @@ static void process_samples(long long now, int min_buf)
     pcm_time_unlock(pcm_stream);
 }
 
-static void *synth_thread(void *arg)
+static void midomunt_synth_run(void *arg, long long now)
 {
-    while (1) {
-	sem_wait(&syn_sem);
-	pthread_mutex_lock(&syn_mtx);
-	if (!output_running) {
-		pthread_mutex_unlock(&syn_mtx);
-		continue;
-	}
-	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-	process_samples(GETusTIME(0), MUNT_MIN_BUF);
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-	pthread_mutex_unlock(&syn_mtx);
-    }
-    return NULL;
-}
-
-static void midomunt_run(void)
-{
-    if (!output_running)
-	return;
-    sem_post(&syn_sem);
+    pthread_mutex_lock(&syn_mtx);
+    if (output_running)
+	process_samples(now, MUNT_MIN_BUF);
+    pthread_mutex_unlock(&syn_mtx);
 }
 
 static int midomunt_cfg(void *arg)
@@ -213,7 +189,7 @@ static const struct midi_out_plugin midomunt
     MIDI_W_PCM | MIDI_W_PREFERRED,
     midomunt_write,
     midomunt_stop,
-    midomunt_run,
+    NULL,
     ST_MT32,
     0
 };
@@ -227,7 +203,6 @@ static const struct midi_out_plugin midomunt
     .weight = MIDI_W_PCM | MIDI_W_PREFERRED,
     .write = midomunt_write,
     .stop = midomunt_stop,
-    .run = midomunt_run,
     .stype = ST_MT32,
 };
 #endif
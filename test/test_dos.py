@@ -3571,6 +3571,148 @@ $_floppy_a = ""
 
         self.assertIn("PSP structure okay", results)
 
+    def test_pit_irq0_4khz(self):
+        """PIT IRQ0 delivery at 4kHz"""
+        ename = "pitirq0"
+
+        mkfile("testit.bat", """\
+c:\\%s\r
+rem end\r
+""" % ename)
+
+        # The PIT runs at 1193182 / 298 = 4004Hz for four seconds of the
+        # RTC, which does not depend on the PIT, and IRQ0 is counted.
+        # The longer interval keeps a late tick at either end small.
+        mkcom(ename, r"""
+.text
+.code16
+
+    .globl  _start16
+_start16:
+
+# hook IRQ0 without chaining, save the old vector
+    movw    $0x3508, %ax
+    int     $0x21
+    movw    %bx, oldofs
+    movw    %es, oldseg
+    movw    $0x2508, %ax
+    movw    $irq0, %dx
+    int     $0x21
+
+# start on an RTC second boundary
+    call    waitsec
+
+    cli
+    movb    $0x34, %al              # ch0, lo/hi, mode 2
+    outb    %al, $0x43
+    movw    $298, %ax
+    outb    %al, $0x40
+    movb    %ah, %al
+    outb    %al, $0x40
+    movw    $0, count
+    sti
+
+    call    waitsec
+    call    waitsec
+    call    waitsec
+    call    waitsec
+
+    cli
+    movw    count, %cx
+    movb    $0x36, %al              # back to the 18.2Hz BIOS default
+    outb    %al, $0x43
+    xorb    %al, %al
+    outb    %al, $0x40
+    outb    %al, $0x40
+    sti
+
+    push    %ds
+    movw    $0x2508, %ax
+    movw    oldofs, %dx
+    movw    oldseg, %ds
+    int     $0x21
+    pop     %ds
+
+# print the count in decimal
+    movw    $countmsg, %dx
+    movb    $0x9, %ah
+    int     $0x21
+    movw    %cx, %ax
+    movw    $10, %bx
+    xorw    %cx, %cx
+1:
+    xorw    %dx, %dx
+    divw    %bx
+    push    %dx
+    incw    %cx
+    testw   %ax, %ax
+    jnz     1b
+2:
+    pop     %dx
+    addb    $0x30, %dl
+    movb    $0x2, %ah
+    int     $0x21
+    loop    2b
+    movw    $crlf, %dx
+    movb    $0x9, %ah
+    int     $0x21
+
+    movw    $0x4c00, %ax
+    int     $0x21
+
+irq0:
+    incw    %cs:count
+    push    %ax
+    movb    $0x20, %al
+    outb    %al, $0x20
+    pop     %ax
+    iret
+
+# wait until the RTC seconds register changes
+waitsec:
+    call    rdsec
+    movb    %al, %bl
+1:
+    call    rdsec
+    cmpb    %al, %bl
+    je      1b
+    ret
+
+rdsec:
+    movb    $0x0a, %al
+    outb    %al, $0x70
+    inb     $0x71
+    testb   $0x80, %al              # update in progress
+    jnz     rdsec
+    xorb    %al, %al
+    outb    %al, $0x70
+    inb     $0x71
+    ret
+
+count:
+    .word   0
+oldofs:
+    .word   0
+oldseg:
+    .word   0
+
+countmsg:
+    .ascii  "IRQ0 count: $"
+crlf:
+    .ascii  "\r\n$"
+""")
+
+        results = self.runDosemu("testit.bat", config="""\
+$_hdimage = "dXXXXs/c:hdtype1 +1"
+$_floppy_a = ""
+""", timeout=20)
+
+        m = re.search(r"IRQ0 count: (\d+)", results)
+        self.assertIsNotNone(m, "No count printed")
+        # 16016 expected, allow 10% for host scheduling on a loaded box
+        self.assertTrue(14400 <= int(m.group(1)) <= 17600,
+                        "IRQ0 count %s, expected about 16016" % m.group(1))
+
 # Tests using neiher compiler nor assembler
 
     def test_systype(self):
@@ -0,0 +1,211 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: microbenchmark for coopth create/start/switch/join.
+ *
+ * coopth.c is linked with libpcl and mcontext as in dosemu. The few
+ * emulator symbols it needs are provided below. The HLT block is
+ * simulated: guest_hlt() calls the handler registered for cs:ip,
+ * which is what the CPU loop does when the guest hits that HLT.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "emu.h"
+#include "utilities.h"
+#include "timers.h"
+#include "hlt.h"
+#include "coopth.h"
+#include "unit.h"
+
+union vm86_union vm86u;
+struct config_info config;
+
+void __leavedos(int code, int sig, const char *s, int num)
+{
+    fprintf(stderr, "leavedos(%i) from %s:%i\n", code, s, num);
+    exit(code);
+}
+
+void dosemu_error(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+void dosemu_sleep(void)
+{
+}
+
+#define MAX_HLT 64
+static emu_hlt_t hlts[MAX_HLT];
+static Bit16u hlt_base[MAX_HLT];
+static int hlt_num;
+static Bit16u hlt_next;
+
+Bit16u hlt_register_handler(emu_hlt_t h)
+{
+    if (hlt_num >= MAX_HLT)
+	__leavedos(1, 0, __func__, __LINE__);
+    hlts[hlt_num] = h;
+    hlt_base[hlt_num] = hlt_next;
+    hlt_next += h.len;
+    return hlt_base[hlt_num++];
+}
+
+/* the guest executes the HLT at cs:ip */
+static void guest_hlt(void)
+{
+    int i;
+
+    for (i = hlt_num - 1; i >= 0; i--) {
+	if (LWORD(eip) >= hlt_base[i]) {
+	    hlts[i].func(LWORD(eip) - hlt_base[i], hlts[i].arg);
+	    return;
+	}
+    }
+}
+
+static void nop_thr(void *arg)
+{
+}
+
+static volatile int stop;
+
+static void sleeper(void *arg)
+{
+    while (!stop)
+	coopth_sleep();
+}
+
+static void deep_thr(void *arg)
+{
+    volatile char buf[64 * 1024];
+    int i;
+
+    for (i = 0; i < sizeof(buf); i += 64)
+	buf[i] = 1;
+}
+
+static void report(const char *what, double t, int n)
+{
+    printf("%-22s %6.1f ns\n", what, (unit_now() - t) * 1e9 / n);
+}
+
+static void print_vm(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+
+    if (!f)
+	return;
+    while (fgets(line, sizeof(line), f)) {
+	if (!strncmp(line, "VmRSS", 5) || !strncmp(line, "VmSize", 6))
+	    printf("%s", line);
+    }
+    fclose(f);
+}
+
+#define N 1000000
+
+int main(void)
+{
+    int det, joi, sl, idle[8], deep;
+    int i;
+    double t;
+
+    _EFLAGS = VIF;
+    coopth_init();
+    t = unit_now();
+    for (i = 0; i < 32; i++)
+	coopth_create("create");
+    report("create", t, 32);
+    det = coopth_create("detached");
+    coopth_set_detached(det);
+    joi = coopth_create("joinable");
+    sl = coopth_create("sleeper");
+    coopth_set_detached(sl);
+    deep = coopth_create_multi("deep", 8);
+    for (i = 0; i < 8; i++) {
+	idle[i] = coopth_create("idle");
+	coopth_set_detached(idle[i]);
+    }
+
+    /* warm up the stack pool */
+    for (i = 0; i < 1000; i++) {
+	coopth_start(det, nop_thr, NULL);
+	coopth_run();
+    }
+    t = unit_now();
+    for (i = 0; i < N; i++) {
+	coopth_start(det, nop_thr, NULL);
+	coopth_run();
+    }
+    report("detached start+join", t, N);
+
+    t = unit_now();
+    for (i = 0; i < N; i++) {
+	coopth_start(joi, nop_thr, NULL);
+	guest_hlt();		/* runs the thread */
+	guest_hlt();		/* DONE switch, joins */
+    }
+    report("joinable start+join", t, N);
+
+    coopth_start(sl, sleeper, NULL);
+    coopth_run();
+    t = unit_now();
+    for (i = 0; i < N; i++) {
+	coopth_wake_up(sl);
+	coopth_run();
+    }
+    report("wake+switch, 1 thr", t, N);
+
+    for (i = 0; i < 8; i++)
+	coopth_start(idle[i], sleeper, NULL);
+    coopth_run();
+    t = unit_now();
+    for (i = 0; i < N; i++) {
+	coopth_wake_up(sl);
+	coopth_run();
+    }
+    report("wake+switch, 9 thr", t, N);
+    stop = 1;
+    coopth_wake_up(sl);
+    for (i = 0; i < 8; i++)
+	coopth_wake_up(idle[i]);
+    coopth_run();
+
+    /* every tid of a multi-thread touching 64K of its stack */
+    t = unit_now();
+    for (i = 0; i < N / 10; i++) {
+	int tid = deep + i % 8;
+
+	coopth_set_detached(tid);
+	coopth_start(tid, deep_thr, NULL);
+	coopth_run();
+    }
+    report("8 tids, 64K stack", t, N / 10);
+    print_vm();
+
+    coopth_done();
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test for dma_burst_DRQ() against the per-unit DMA path.
+ *
+ * dma.c is linked against a flat 1MB+64K buffer standing in for the
+ * guest memory, and the controller is programmed through its port
+ * handler the way the SB driver of a DOS program does it. Checked are
+ * the stop at terminal count and the auto-init wrap of a 64K block,
+ * which must give the same bytes as single DRQs would.
+ *
+ * With "-b" a 64K auto-init block is read with single DRQs and with
+ * 32 and 64 byte bursts, and the throughput is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emu.h"
+#include "port.h"
+#include "memory.h"
+#include "dma.h"
+#include "unit.h"
+
+static Bit8u *mem;
+static void (*dma_write)(ioport_t port, Bit8u byte);
+
+int register_debug_class(int letter, void (*change_level)(int level),
+	const char *help_text)
+{
+    return 0;
+}
+
+void *physaddr_to_unixaddr(dosaddr_t addr)
+{
+    return mem + addr;
+}
+
+int port_register_handler(emu_iodev_t info, int flags)
+{
+    dma_write = info.write_portb;
+    return 0;
+}
+
+/* 8-bit channel 1 reading (mem->device) from 1000:0000 */
+static void setup(unsigned count, int autoinit)
+{
+    dma_write(0x0a, 0x05);		/* mask */
+    dma_write(0x0c, 0);			/* clear flip-flop */
+    dma_write(0x02, 0x00);
+    dma_write(0x02, 0x00);
+    dma_write(0x03, count & 0xff);
+    dma_write(0x03, count >> 8);
+    dma_write(0x83, 0x01);
+    dma_write(0x0b, autoinit ? 0x59 : 0x49);
+    dma_write(0x0a, 0x01);		/* unmask */
+}
+
+static void test_tc(void)
+{
+    Bit8u buf[64];
+    int a, b, c;
+
+    setup(100, 0);
+    a = dma_burst_DRQ(1, buf, 64);
+    b = dma_burst_DRQ(1, buf, 64);
+    c = dma_burst_DRQ(1, buf, 64);
+    unit_check("TC of a 101 byte block: 64, 37, 0",
+	    a == 64 && b == 37 && c == 0);
+}
+
+static void test_wrap(void)
+{
+    Bit8u buf[64];
+    int i, j, n;
+
+    for (i = 0; i < 0x10000; i++)
+	mem[0x10000 + i] = i * 7;
+    /* odd burst sizes so the runs end everywhere relative to the wrap */
+    setup(0xffff, 1);
+    for (i = 0; i < 0x30000; i += n) {
+	n = dma_burst_DRQ(1, buf, 1 + i % 61);
+	if (n <= 0)
+	    break;
+	for (j = 0; j < n; j++) {
+	    if (buf[j] != (Bit8u)(((i + j) & 0xffff) * 7))
+		break;
+	}
+	if (j < n)
+	    break;
+    }
+    /* and the per-unit path must still agree after the bursts */
+    for (j = 0; j < 0x100 && i >= 0x30000; j++) {
+	dma_pulse_DRQ(1, buf);
+	if (buf[0] != (Bit8u)(((i + j) & 0xffff) * 7))
+	    i = 0;
+    }
+    unit_check("auto-init wrap", i >= 0x30000);
+}
+
+static void bench(void)
+{
+    Bit8u buf[64];
+    long total = 256L << 20, i;
+    double t;
+    int k;
+
+    setup(0xffff, 1);
+    t = unit_now();
+    for (i = 0; i < total; i++)
+	dma_pulse_DRQ(1, buf);
+    printf("single DRQ:     %7.1f MB/s\n", total / (unit_now() - t) / 1e6);
+    for (k = 32; k <= 64; k *= 2) {
+	setup(0xffff, 1);
+	t = unit_now();
+	for (i = 0; i < total; i += k)
+	    dma_burst_DRQ(1, buf, k);
+	printf("%d byte burst:  %7.1f MB/s\n", k,
+		total / (unit_now() - t) / 1e6);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    mem = calloc(1, 0x110000);
+    dma_init();
+    if (unit_bench_mode(argc, argv)) {
+	bench();
+	return 0;
+    }
+    test_tc();
+    test_wrap();
+    return unit_result();
+}
@@ -0,0 +1,301 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: cost of the effect processor chain in sndpcm.
+ *
+ * sndpcm.c runs on a fake clock. Two S16 stereo streams, the second at
+ * half volume, are written in fragments and read back by two players.
+ * The first player has no efps. Its output goes through three one-pole
+ * HPFs (the filter.so "hpf") that convert every sample to float and
+ * back with a format switch, which is what efps did before they got
+ * planar float blocks. The second player has the same three HPFs
+ * connected as real efps, so it gets the float mixing path and one
+ * conversion at the end. The time is per output sample, and the
+ * largest difference between the two outputs is printed as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "emu.h"
+#include "timers.h"
+#include "sound/sound.h"
+#include "unit.h"
+
+#define RATE 44100
+#define SECS 10
+#define NEFP 3
+
+static long long fake_now;
+
+hitimer_t GETusTIME(int sc)
+{
+    return fake_now;
+}
+
+struct hpf {
+    float a0, a1, b1, x1, y1;
+};
+
+static void hpf_init(struct hpf *f, float fc, int rate)
+{
+    float x = expf(-2 * M_PI * fc / rate);
+
+    f->a0 = (1 + x) / 2;
+    f->a1 = -(1 + x) / 2;
+    f->b1 = x;
+    f->x1 = f->y1 = 0;
+}
+
+static void hpf_run(struct hpf *f, const float *in, float *out, int n)
+{
+    float a0 = f->a0, a1 = f->a1, b1 = f->b1, x1 = f->x1, y1 = f->y1;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	float x = in[i];
+	float y = a0 * x + a1 * x1 + b1 * y1;
+
+	x1 = x;
+	y1 = y;
+	out[i] = y;
+    }
+    f->x1 = x1;
+    f->y1 = y1;
+}
+
+/* the efp, one HPF per handle and channel */
+static struct hpf hpfs[NEFP * 2][SNDBUF_CHANS];
+static int num_hpfs;
+
+static int hpf_cfg(void *arg)
+{
+    return PCM_CF_ENABLED;
+}
+
+static int hpf_open(void *arg)
+{
+    return 1;
+}
+
+static void hpf_start(int handle)
+{
+}
+
+static void hpf_stop(int handle)
+{
+}
+
+static int hpf_setup(int rate, int channels, float fc, void *arg)
+{
+    int i;
+
+    for (i = 0; i < SNDBUF_CHANS; i++)
+	hpf_init(&hpfs[num_hpfs][i], fc, rate);
+    return num_hpfs++;
+}
+
+static int hpf_process(int handle, float *buf[SNDBUF_CHANS], int nframes,
+	int channels, int srate)
+{
+    int i;
+
+    for (i = 0; i < channels; i++)
+	hpf_run(&hpfs[handle][i], buf[i], buf[i], nframes);
+    return 0;
+}
+
+static const struct pcm_efp efp_hpf = {
+    .name = "hpf",
+    .get_cfg = hpf_cfg,
+    .open = hpf_open,
+    .start = hpf_start,
+    .stop = hpf_stop,
+    .setup = hpf_setup,
+    .process = hpf_process,
+};
+
+/* the old efp interface: interleaved samples in the output format */
+#define SS2F(v) ((*(signed short *)(v)) / 32768.0)
+#define UC2F(v) ((*(unsigned char *)(v) - 128) / 128.0)
+#define F2SS(v) ((signed short)(lrintf((v) * 32767)))
+#define F2UC(v) ((unsigned char)(lrintf((v) * 127) + 128))
+
+static float sample_to_float(void *data, int format)
+{
+    switch (format) {
+    case PCM_FORMAT_U8:
+	return UC2F(data);
+    case PCM_FORMAT_S16_LE:
+	return SS2F(data);
+    default:
+	error("format %i is not supported\n", format);
+	return 0;
+    }
+}
+
+static void float_to_sample(float sample, sndbuf_t *buf, int format)
+{
+    switch (format) {
+    case PCM_FORMAT_U8:
+	*buf = F2UC(sample);
+	break;
+    case PCM_FORMAT_S16_LE:
+	*buf = F2SS(sample);
+	break;
+    default:
+	error("format %i is not supported\n", format);
+    }
+}
+
+static void old_efp_chain(sndbuf_t buf[][SNDBUF_CHANS], int n, int channels,
+	int format)
+{
+    float tin[n], tout[n];
+    int e, i, j;
+
+    for (e = 0; e < NEFP; e++) {
+	for (i = 0; i < channels; i++) {
+	    for (j = 0; j < n; j++)
+		tin[j] = sample_to_float(&buf[j][i], format);
+	    hpf_run(&hpfs[NEFP + e][i], tin, tout, n);
+	    for (j = 0; j < n; j++)
+		float_to_sample(tout[j], &buf[j][i], format);
+	}
+    }
+}
+
+/* the players */
+static int pl_cfg(void *arg)
+{
+    return PCM_CF_ENABLED;
+}
+
+static int pl_open(void *arg)
+{
+    return 1;
+}
+
+static void pl_start(void *arg)
+{
+}
+
+static void pl_stop(void *arg)
+{
+}
+
+static const struct pcm_player player = {
+    .name = "bench",
+    .get_cfg = pl_cfg,
+    .open = pl_open,
+    .start = pl_start,
+    .stop = pl_stop,
+    .id = PCM_ID_P,
+};
+
+static double get_vol(int id, int chan_dst, int chan_src, void *arg)
+{
+    if (chan_dst != chan_src)
+	return 0;
+    return arg ? 0.5 : 1.0;
+}
+
+static void run(int frag)
+{
+    struct player_params pp[2];
+    int total = RATE * SECS, done = 0, got[2] = { 0, 0 };
+    sndbuf_t (*out)[2][SNDBUF_CHANS] = malloc(sizeof(*out) * total * 2);
+    sndbuf_t in[frag][SNDBUF_CHANS];
+    double t_old = 0, t_new = 0;
+    long maxd = 0;
+    int i, j, k;
+
+    for (i = 0; i < 2; i++) {
+	pp[i].rate = RATE;
+	pp[i].format = PCM_FORMAT_S16_LE;
+	pp[i].channels = 2;
+	pp[i].handle = i;
+    }
+    while (done < total) {
+	fake_now += frag * 1000000LL / RATE;
+	for (k = 0; k < 2; k++) {
+	    for (i = 0; i < frag; i++) {
+		for (j = 0; j < SNDBUF_CHANS; j++)
+		    in[i][j] = 12000 * sin((done + i) *
+			    (0.01 + 0.003 * k + 0.001 * j)) +
+			    (rand() % 2000 - 1000);
+	    }
+	    pcm_write_interleaved(in, frag, RATE, PCM_FORMAT_S16_LE, 2, k);
+	}
+	done += frag;
+	pcm_timer();
+
+	for (k = 0; k < 2; k++) {
+	    sndbuf_t buf[frag][SNDBUF_CHANS];
+	    double t = unit_now();
+	    int n = pcm_data_get_interleaved(buf, frag, &pp[k]);
+
+	    if (k == 0) {
+		old_efp_chain(buf, n, 2, PCM_FORMAT_S16_LE);
+		t_old += unit_now() - t;
+	    } else {
+		t_new += unit_now() - t;
+	    }
+	    for (i = 0; i < n && got[k] < total * 2; i++, got[k]++)
+		memcpy(out[got[k]][k], buf[i], sizeof(buf[i]));
+	}
+    }
+    for (i = 0; i < got[0] && i < got[1]; i++) {
+	for (j = 0; j < SNDBUF_CHANS; j++) {
+	    long d = labs(out[i][0][j] - out[i][1][j]);
+
+	    if (d > maxd)
+		maxd = d;
+	}
+    }
+    printf("frag %4d: per-sample conversion %5.2f ns, float block %5.2f ns, "
+	    "max diff %ld LSB\n", frag, t_old * 1e9 / (got[0] * 2),
+	    t_new * 1e9 / (got[1] * 2), maxd);
+    free(out);
+}
+
+int main(void)
+{
+    int frags[] = { 512, 1024, 1536 };
+    int i, j;
+
+    fake_now = 10000000;
+    pcm_register_efp(&efp_hpf, EFP_HPF, NULL);
+    pcm_register_player(&player, NULL);
+    pcm_register_player(&player, NULL);
+    pcm_init();
+    pcm_set_volume_cb(get_vol);
+    pcm_allocate_stream(2, "stream 0", NULL);
+    pcm_allocate_stream(2, "stream 1", (void *)1);
+    for (i = 0; i < NEFP; i++)
+	pcm_setup_efp(1, EFP_HPF, RATE, 2, 50 + i * 20);
+    /* the plain player's HPFs, with the same cutoffs */
+    for (i = 0; i < NEFP; i++)
+	for (j = 0; j < SNDBUF_CHANS; j++)
+	    hpf_init(&hpfs[NEFP + i][j], 50 + i * 20, RATE);
+    /* keep the filter state and the streams running between the runs */
+    for (i = 0; i < sizeof(frags) / sizeof(frags[0]); i++)
+	run(frags[i]);
+    pcm_done();
+    return 0;
+}
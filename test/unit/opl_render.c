@@ -0,0 +1,161 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: offline render test for the OPL2/OPL3 emulator.
+ *
+ * A pseudo-random stream of register writes is rendered in blocks of
+ * random size and the 16-bit output is hashed. The stream covers OPL3
+ * stereo, 4-op channels, percussion, every waveform and every feedback
+ * setting. The expected hashes come from the per-sample renderer that
+ * opl.c had before the block renderer, so any change to the output,
+ * down to one LSB, fails the test. The noise generator uses rand(), so
+ * they are only valid with glibc.
+ *
+ * With "-b" the steady 18-channel stream is rendered instead and only
+ * the time is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "types.h"
+#include "opl.h"
+#include "unit.h"
+
+struct scenario {
+    const char *name;
+    int opl3;
+    int sustain;		/* force EG type on, most operators sustain */
+    uint64_t hash;
+};
+
+static const struct scenario scenarios[] = {
+    { "opl3",         1, 0, 0x5daf547b5bb49ec3ULL },
+    { "opl2",         0, 0, 0x4f959d699a45a46fULL },
+    { "opl3 sustain", 1, 1, 0x86b68030e1425d66ULL },
+};
+
+static uint32_t lcg;
+
+static unsigned rnd(void)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return lcg >> 8;
+}
+
+static uint64_t render(const struct scenario *sc, int iter, int bench)
+{
+    static Bit16s buf[1024 * 2];
+    uint64_t h = 1469598103934665603ULL;
+    int it, k;
+
+    lcg = 12345;
+    srand(1);			/* the noise generator uses rand() */
+    opl_init(44100);
+    if (sc->opl3)
+	opl_write(0x105, 1);
+    opl_write(0x104, 0x09);	/* two 4-op channels */
+    opl_write(0x01, 0x20);
+    for (it = 0; it < iter; it++) {
+	int nw = bench ? (it % 64 == 0 ? 8 : 0) : rnd() % 12;
+	int n;
+
+	for (k = 0; k < nw; k++) {
+	    unsigned r = rnd(), set = (r & 1) ? 0x100 : 0;
+	    unsigned reg, val = rnd() & 0xff;
+
+	    switch ((r >> 1) % 10) {
+	    case 0:
+		reg = 0x20 + rnd() % 0x16;
+		if (sc->sustain)
+		    val |= 0x20;
+		break;
+	    case 1:
+		reg = 0x40 + rnd() % 0x16;
+		val &= 0x3f;
+		break;
+	    case 2:
+		reg = 0x60 + rnd() % 0x16;
+		break;
+	    case 3:
+		reg = 0x80 + rnd() % 0x16;
+		break;
+	    case 4:
+		reg = 0xa0 + rnd() % 9;
+		break;
+	    case 5:
+		reg = 0xb0 + rnd() % 9;
+		val &= 0x3f;
+		break;
+	    case 6:
+		reg = 0xc0 + rnd() % 9;
+		break;
+	    case 7:
+		reg = 0xe0 + rnd() % 0x16;
+		val &= 7;
+		break;
+	    case 8:
+		reg = 0xbd;
+		set = 0;
+		if (bench)
+		    val &= ~0x20;
+		break;
+	    default:		/* key on */
+		reg = 0xb0 + rnd() % 9;
+		val = (val & 0x1f) | 0x20;
+		break;
+	    }
+	    if (reg == 0xbd && !bench && (rnd() & 3))
+		val &= ~0x20;
+	    opl_write(set + reg, val);
+	}
+	n = bench ? 512 : 1 + rnd() % 1000;
+	opl_getsample(buf, n);
+	for (k = 0; k < n * 2; k++) {
+	    h ^= (uint16_t)buf[k];
+	    h *= 1099511628211ULL;
+	}
+    }
+    return h;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    if (unit_bench_mode(argc, argv)) {
+	for (i = 0; i < 2; i++) {
+	    double t0 = unit_now();
+
+	    render(&scenarios[i], 20000, 1);
+	    printf("%-12s 20000 blocks of 512 samples: %.2fs\n",
+		    scenarios[i].name, unit_now() - t0);
+	}
+	return 0;
+    }
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+	uint64_t h = render(&scenarios[i], 4000, 0);
+	char what[64];
+
+	snprintf(what, sizeof(what), "%-12s %016llx", scenarios[i].name,
+		(unsigned long long)h);
+	unit_check(what, h == scenarios[i].hash);
+    }
+    return unit_result();
+}
@@ -0,0 +1,286 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test for the bulk REP INS/OUTS handlers of the NE2000.
+ *
+ * ports.c and ne2000.c are linked against stubs for the rest of the
+ * emulator. Every string transfer is done twice, once with the single
+ * port accesses and once with port_rep_*(), starting from the same
+ * card state. The data, the remote DMA address and the RDC bit that
+ * come out must be the same. The transfers cross the ring wrap and
+ * the end of the remote DMA.
+ *
+ * With "-b" the bulk transfers are timed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emu.h"
+#include "port.h"
+#include "vgaemu.h"
+#include "libpacket.h"
+#include "ne2000.h"
+#include "priv.h"
+#include "sig.h"
+#include "unit.h"
+
+struct config_info config;
+int can_do_root_stuff;
+int current_iopl;
+vga_type vga;
+unsigned long pic_irq_list[16];
+const char *tty_locks_dir_path, *tty_locks_name_path;
+
+void LibpacketInit(void)
+{
+}
+
+int OpenNetworkLink(void (*cbk)(int, int))
+{
+    cbk(-1, 0);
+    return 0;
+}
+
+int GetDeviceHardwareAddress(unsigned char *addr)
+{
+    memset(addr, 0, 6);
+    return 0;
+}
+
+void add_to_io_select_new(int fd, void (*func)(void *), void *arg,
+	const char *name)
+{
+}
+
+unsigned char Misc_get_input_status_1(void)
+{
+    return 0;
+}
+
+int pic_request(int inum)
+{
+    return 0;
+}
+
+void pic_untrigger(int inum)
+{
+}
+
+void pic_seti(unsigned int level, int (*func)(int), unsigned int ivec,
+	void (*callback)(void))
+{
+}
+
+void __leavedos(int code, int sig, const char *s, int num)
+{
+    fprintf(stderr, "leavedos(%i) from %s:%i\n", code, s, num);
+    exit(code);
+}
+
+int priv_drop(void)
+{
+    return 0;
+}
+
+int priv_iopl(int pl)
+{
+    return 0;
+}
+
+int real_enter_priv_on(saved_priv_status *privs)
+{
+    return 0;
+}
+
+int real_leave_priv_setting(saved_priv_status *privs)
+{
+    return 0;
+}
+
+int sigchld_register_handler(pid_t pid, void (*handler)(void))
+{
+    return 0;
+}
+
+int sigchld_enable_handler(pid_t pid, int on)
+{
+    return 0;
+}
+
+#define B 0x300
+#define DATA (B + 0x10)
+#define RING_START 0x4000
+#define RING_STOP 0xc000
+
+/* page 0, ring at RING_START..RING_STOP, remote DMA of cnt bytes */
+static void setup(int words, unsigned rsar, unsigned cnt, int write)
+{
+    port_outb(B + 0, 0x21);		/* page 0, stop */
+    port_outb(B + 0x0e, words ? 0x49 : 0x48);
+    port_outb(B + 1, RING_START >> 8);
+    port_outb(B + 2, RING_STOP >> 8);
+    port_outb(B + 7, 0xff);		/* clear ISR */
+    port_outb(B + 8, rsar & 0xff);
+    port_outb(B + 9, rsar >> 8);
+    port_outb(B + 0x0a, cnt & 0xff);
+    port_outb(B + 0x0b, cnt >> 8);
+    port_outb(B + 0, write ? 0x12 : 0x0a);
+}
+
+struct state {
+    unsigned crda;
+    unsigned isr;
+};
+
+static struct state get_state(void)
+{
+    struct state st;
+
+    st.crda = port_inb(B + 8) | (port_inb(B + 9) << 8);
+    st.isr = port_inb(B + 7);
+    return st;
+}
+
+/* fill the whole ring with a known pattern */
+static void fill(void)
+{
+    int i;
+
+    setup(1, RING_START, RING_STOP - RING_START, 1);
+    for (i = 0; i < (RING_STOP - RING_START) / 2; i++)
+	port_outw(DATA, i * 7 + 3);
+}
+
+static Bit16u ref[32768], buf[32768];
+
+static void check_in(const char *what, int words, unsigned rsar,
+	unsigned cnt, unsigned n, int df)
+{
+    struct state s1, s2;
+    int i, size = words ? 2 : 1;
+
+    fill();
+    memset(ref, 0, sizeof(ref));
+    memset(buf, 0, sizeof(buf));
+    setup(words, rsar, cnt, 0);
+    for (i = 0; i < n; i++) {
+	int idx = df ? n - 1 - i : i;
+
+	if (words)
+	    ref[idx] = port_inw(DATA);
+	else
+	    ((Bit8u *)ref)[idx] = port_inb(DATA);
+    }
+    s1 = get_state();
+    setup(words, rsar, cnt, 0);
+    if (words)
+	port_rep_inw(DATA, df ? buf + n - 1 : buf, df, n);
+    else
+	port_rep_inb(DATA, df ? (Bit8u *)buf + n - 1 : (Bit8u *)buf, df, n);
+    s2 = get_state();
+    unit_check(what, memcmp(ref, buf, n * size) == 0 &&
+	    s1.crda == s2.crda && s1.isr == s2.isr);
+}
+
+/* read the whole ring back with single accesses */
+static void dump(Bit16u *dst)
+{
+    int i;
+
+    setup(1, RING_START, RING_STOP - RING_START, 0);
+    for (i = 0; i < (RING_STOP - RING_START) / 2; i++)
+	dst[i] = port_inw(DATA);
+}
+
+static void check_out(const char *what, int words, unsigned rsar,
+	unsigned cnt, unsigned n)
+{
+    static Bit16u src[32768];
+    struct state s1, s2;
+    int i;
+
+    for (i = 0; i < n; i++)
+	src[i] = 0x8000 | i;
+    fill();
+    setup(words, rsar, cnt, 1);
+    for (i = 0; i < n; i++) {
+	if (words)
+	    port_outw(DATA, src[i]);
+	else
+	    port_outb(DATA, ((Bit8u *)src)[i]);
+    }
+    s1 = get_state();
+    dump(ref);
+    fill();
+    setup(words, rsar, cnt, 1);
+    if (words)
+	port_rep_outw(DATA, src, 0, n);
+    else
+	port_rep_outb(DATA, (Bit8u *)src, 0, n);
+    s2 = get_state();
+    dump(buf);
+    unit_check(what, memcmp(ref, buf, RING_STOP - RING_START) == 0 &&
+	    s1.crda == s2.crda && s1.isr == s2.isr);
+}
+
+static void bench(void)
+{
+    int i, iters = 2000;
+    double t;
+
+    t = unit_now();
+    for (i = 0; i < iters; i++) {
+	setup(1, RING_START, 0xffff, 0);
+	port_rep_inw(DATA, buf, 0, 32768);
+    }
+    printf("REP INSW 64K:            %8.2f us\n",
+	    (unit_now() - t) * 1e6 / iters);
+    t = unit_now();
+    for (i = 0; i < iters; i++) {
+	setup(1, RING_START, 0xffff, 1);
+	port_rep_outw(DATA, buf, 0, 32768);
+    }
+    printf("REP OUTSW 64K:           %8.2f us\n",
+	    (unit_now() - t) * 1e6 / iters);
+    t = unit_now();
+    for (i = 0; i < iters * 10; i++) {
+	setup(1, RING_START, 1514, 0);
+	port_rep_inw(DATA, buf, 0, 757);
+    }
+    printf("REP INSW 1514 byte packet: %6.2f us\n",
+	    (unit_now() - t) * 1e6 / iters / 10);
+}
+
+int main(int argc, char **argv)
+{
+    config.ne2k = 1;
+    port_init();
+    ne2000_init();
+    if (unit_bench_mode(argc, argv)) {
+	bench();
+	return 0;
+    }
+    check_in("insw 64K, ring wrap, DMA end", 1, RING_START, 0xffff, 32768, 0);
+    check_in("insw packet before the ring end", 1, 0xbc00, 1514, 757, 0);
+    check_in("insw past the end of the DMA", 1, 0x5000, 100, 60, 0);
+    check_in("insb odd start and count", 0, 0x4003, 1001, 1001, 0);
+    check_in("insw with DF=1", 1, 0x6000, 512, 256, 1);
+    check_out("outsw across the ring wrap", 1, 0xbf00, 1514, 757);
+    check_out("outsb odd start and count", 0, 0x7001, 333, 333);
+    return unit_result();
+}
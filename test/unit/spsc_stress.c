@@ -0,0 +1,238 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: stress test for the spsc ring, used the way the fluidsynth
+ * plugin uses it.
+ *
+ * The writer is midoflus_write(): it puts timestamped MIDI bytes into
+ * the ring, keeps them in a private spill buffer while the ring is
+ * full and drops them only when the spill buffer is full too. The
+ * "synth" thread wakes every millisecond and renders for two more with
+ * the mutex held, draining the ring as it goes. The writer must never
+ * take the mutex or wait for the render, and the bytes that arrive
+ * must be in order. A wait would be a voluntary context switch of the
+ * writer thread; being preempted is not.
+ *
+ * The paced run writes SysEx at about 1MB/s, roughly what a guest
+ * gets with one OUT per byte to the MPU-401, in 32K bursts, into a
+ * ring of the plugin's size. Nothing may be dropped there. The flood
+ * run writes as fast as it can, so the spill buffer fills up and bytes
+ * get dropped, but the writer still must not wait.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "ringbuf.h"
+#include "unit.h"
+
+struct ev {
+    long long time;
+    unsigned char data;
+};
+
+#define SYX_LEN 64
+#define SPILL_SIZE 4096		/* FLUS_SPILL_SIZE */
+#define RENDER_NS 2000000	/* syn_mtx hold time of one render */
+
+static struct spsc_s queue;
+static pthread_mutex_t syn_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t writer;
+static long long delivered, errors, last, dropped, writer_locks;
+static struct ev spill[SPILL_SIZE];
+static int spill_head, spill_len, spill_max;
+static volatile int done;
+
+static unsigned char ev_byte(long long i)
+{
+    switch (i % SYX_LEN) {
+    case 0:
+	return 0xf0;
+    case SYX_LEN - 1:
+	return 0xf7;
+    }
+    return (i * 7) & 0x7f;
+}
+
+static void lock_syn(void)
+{
+    if (pthread_equal(pthread_self(), writer))
+	writer_locks++;
+    pthread_mutex_lock(&syn_mtx);
+}
+
+/* called with syn_mtx held */
+static void send_event(const struct ev *e)
+{
+    if (e->time <= last || e->data != ev_byte(e->time))
+	errors++;
+    last = e->time;
+    delivered++;
+}
+
+/* called with syn_mtx held */
+static void drain_queue(void)
+{
+    struct ev e;
+
+    while (spsc_peek(&queue, &e)) {
+	send_event(&e);
+	spsc_get(&queue, NULL);
+    }
+}
+
+static void *synth_thread(void *arg)
+{
+    struct timespec ts = { 0, 1000000 };
+    struct timespec render = { 0, RENDER_NS };
+
+    while (!done) {
+	nanosleep(&ts, NULL);
+	lock_syn();
+	drain_queue();
+	nanosleep(&render, NULL);
+	drain_queue();
+	pthread_mutex_unlock(&syn_mtx);
+    }
+    return NULL;
+}
+
+/* mf_flush_spill() */
+static void flush_spill(void)
+{
+    while (spill_len && spsc_put(&queue, &spill[spill_head])) {
+	spill_head = (spill_head + 1) % SPILL_SIZE;
+	spill_len--;
+    }
+}
+
+/* midoflus_write() */
+static void write_ev(const struct ev *e)
+{
+    flush_spill();
+    if (!spill_len && spsc_put(&queue, e))
+	return;
+    if (spill_len == SPILL_SIZE) {
+	dropped++;
+	return;
+    }
+    spill[(spill_head + spill_len) % SPILL_SIZE] = *e;
+    spill_len++;
+    if (spill_len > spill_max)
+	spill_max = spill_len;
+}
+
+/* midoflus_stop(), called with syn_mtx held */
+static void drain_spill(void)
+{
+    while (spill_len) {
+	send_event(&spill[spill_head]);
+	spill_head = (spill_head + 1) % SPILL_SIZE;
+	spill_len--;
+    }
+}
+
+static long writer_csw(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_nvcsw;
+}
+
+/* write total bytes in bursts of burst bytes, one per ns_per_byte,
+ * with gap_ms of sound ticks between the bursts; ns_per_byte 0 floods */
+static void run(const char *name, unsigned qsize, long long total,
+	long long burst, double ns_per_byte, int gap_ms, int drops_ok)
+{
+    pthread_t thr;
+    long long i;
+    double t0, tb, max_put = 0;
+    long csw, waits = 0;
+    char what[80];
+
+    spsc_init(&queue, qsize, sizeof(struct ev));
+    delivered = errors = dropped = writer_locks = 0;
+    last = -1;
+    spill_head = spill_len = spill_max = 0;
+    done = 0;
+    writer = pthread_self();
+    pthread_create(&thr, NULL, synth_thread, NULL);
+    t0 = tb = unit_now();
+    csw = writer_csw();
+    for (i = 0; i < total; i++) {
+	struct ev e = { i, ev_byte(i) };
+	double t;
+
+	if (ns_per_byte) {
+	    double due = tb + (i % burst) * ns_per_byte * 1e-9;
+
+	    while (unit_now() < due);
+	}
+	t = unit_now();
+	write_ev(&e);
+	t = unit_now() - t;
+	if (t > max_put)
+	    max_put = t;
+	if (i % burst == burst - 1) {
+	    struct timespec tick = { 0, 1000000 };
+	    int j;
+
+	    waits += writer_csw() - csw;
+	    /* the sound ticks between the bursts, midoflus_run() */
+	    for (j = 0; j < gap_ms; j++) {
+		nanosleep(&tick, NULL);
+		flush_spill();
+	    }
+	    tb = unit_now();
+	    csw = writer_csw();
+	}
+    }
+    done = 1;
+    pthread_join(thr, NULL);
+    lock_syn();
+    drain_queue();
+    drain_spill();
+    pthread_mutex_unlock(&syn_mtx);
+    /* the final flush is midoflus_stop(), the puts must not lock */
+    writer_locks--;
+    spsc_destroy(&queue);
+
+    printf("%s: %lld/%lld bytes in %.2fs, %lld dropped, %lld order "
+	    "errors, spill peak %i, slowest write %.0fus, %li waits\n", name,
+	    delivered, total, unit_now() - t0, dropped, errors, spill_max,
+	    max_put * 1e6, waits);
+    snprintf(what, sizeof(what), "%s: %s", name,
+	    drops_ok ? "in order" : "all in order");
+    unit_check(what, delivered + dropped == total && !errors &&
+	    (drops_ok || !dropped));
+    snprintf(what, sizeof(what), "%s: writer never locked", name);
+    unit_check(what, writer_locks == 0);
+    snprintf(what, sizeof(what), "%s: writer never waited", name);
+    unit_check(what, waits == 0);
+}
+
+int main(void)
+{
+    run("paced", 8192, 256 * 1024, 32 * 1024, 1000, 20, 0);
+    run("flood", 8192, 2000000, 2000000, 0, 0, 1);
+    return unit_result();
+}
@@ -0,0 +1,131 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: context switches of the synth scheduler.
+ *
+ * Three generators doing a little work each are ticked every 1ms, as
+ * the sound timer does. First every generator gets its own thread and
+ * semaphore, as adlib, fluidsynth and munt had before; then they are
+ * registered with synth.c and ticked with synth_timer(). The context
+ * switches of the process are counted with getrusage(). About half of
+ * the shared worker's count comes from the ticking thread sleeping.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "emu.h"
+#include "timers.h"
+#include "sound/synth.h"
+#include "unit.h"
+
+#define NGENS 3
+#define TICKS 3000
+
+hitimer_t GETusTIME(int sc)
+{
+    return unit_now() * 1000000;
+}
+
+static volatile int runs[NGENS];
+
+static void work(void)
+{
+    volatile double x = 0;
+    int i;
+
+    for (i = 0; i < 20000; i++)
+	x += i * 0.5;
+}
+
+static void gen_run(void *arg, long long now)
+{
+    work();
+    runs[(long)arg]++;
+}
+
+static sem_t sems[NGENS];
+
+static void *gen_thread(void *arg)
+{
+    while (1) {
+	sem_wait(&sems[(long)arg]);
+	gen_run(arg, GETusTIME(0));
+    }
+    return NULL;
+}
+
+static long csw(void)
+{
+    struct rusage r;
+
+    getrusage(RUSAGE_SELF, &r);
+    return r.ru_nvcsw + r.ru_nivcsw;
+}
+
+static void tick(void)
+{
+    struct timespec ts = { 0, 1000000 };
+
+    nanosleep(&ts, NULL);
+}
+
+int main(void)
+{
+    pthread_t thr[NGENS];
+    long i, k, c;
+
+    for (i = 0; i < NGENS; i++) {
+	sem_init(&sems[i], 0, 0);
+	pthread_create(&thr[i], NULL, gen_thread, (void *)i);
+    }
+    c = csw();
+    for (k = 0; k < TICKS; k++) {
+	tick();
+	for (i = 0; i < NGENS; i++)
+	    sem_post(&sems[i]);
+    }
+    printf("thread per synth: %6ld context switches in %d ticks\n",
+	    csw() - c, TICKS);
+    for (i = 0; i < NGENS; i++) {
+	pthread_cancel(thr[i]);
+	pthread_join(thr[i], NULL);
+    }
+
+    for (i = 0; i < NGENS; i++) {
+	runs[i] = 0;
+	synth_register(gen_run, (void *)i, "gen");
+    }
+    c = csw();
+    for (k = 0; k < TICKS; k++) {
+	tick();
+	synth_timer();
+    }
+    printf("shared worker:    %6ld context switches in %d ticks\n",
+	    csw() - c, TICKS);
+    for (i = 0; i < NGENS; i++)
+	synth_unregister(gen_run, (void *)i);
+    for (i = 1; i < NGENS; i++) {
+	if (runs[i] != runs[0])
+	    break;
+    }
+    unit_check("every generator ran on every pass", i == NGENS);
+    return unit_result();
+}
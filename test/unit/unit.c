@@ -0,0 +1,68 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: shared bits of the standalone tests and benchmarks.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "emu.h"
+#include "unit.h"
+
+unsigned char debug_levels[DEBUG_CLASSES];
+static int failed;
+
+void error(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+int log_printf(int flg, const char *fmt, ...)
+{
+    return 0;
+}
+
+double unit_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int unit_bench_mode(int argc, char **argv)
+{
+    return argc > 1 && strcmp(argv[1], "-b") == 0;
+}
+
+void unit_check(const char *what, int ok)
+{
+    printf("%-40s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok)
+	failed++;
+}
+
+int unit_result(void)
+{
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: shared bits of the standalone tests and benchmarks.
+ *
+ * unit.c also provides the logging symbols (error(), log_printf(),
+ * debug_levels[]) that the emulator sources linked into a test refer
+ * to. Logging is off, errors go to stderr.
+ */
+
+#ifndef UNIT_H
+#define UNIT_H
+
+/* monotonic time in seconds */
+extern double unit_now(void);
+/* non-zero if the program was started with "-b" */
+extern int unit_bench_mode(int argc, char **argv);
+/* print the result of one check, remember failures */
+extern void unit_check(const char *what, int ok);
+/* exit code: 0 if every check passed */
+extern int unit_result(void);
+
+#endif